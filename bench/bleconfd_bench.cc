@@ -0,0 +1,536 @@
+//
+// Copyright [2018] [Comcast, Corp]
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#include "../defs.h"
+#include "../jsonarena.h"
+#include "../jsonrpc.h"
+#include "../loopback.h"
+#include "../rpclogger.h"
+#include "../rpcserver.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <getopt.h>
+#include <sys/resource.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cJSON.h>
+
+// Drives the rpc server end to end over loopback clients. Each stream is a
+// client that sends one request, waits for its response and sends the next,
+// cycling through the lines of a JSONL request file.
+namespace
+{
+  // every allocation in the process goes through the malloc family below,
+  // including operator new. Threads count into their own slot so the
+  // counting doesn't add contention of its own.
+  struct alignas(64) AllocCounter
+  {
+    std::atomic<uint64_t> Count;
+    std::atomic<uint64_t> Bytes;
+  };
+
+  int const kMaxCounterSlots = 256;
+  AllocCounter allocCounters[kMaxCounterSlots];
+  std::atomic<int> nextCounterSlot(0);
+  thread_local int counterSlot = -1;
+
+  inline void countAllocation(size_t n)
+  {
+    if (counterSlot == -1)
+      counterSlot = nextCounterSlot.fetch_add(1, std::memory_order_relaxed) % kMaxCounterSlots;
+    allocCounters[counterSlot].Count.fetch_add(1, std::memory_order_relaxed);
+    allocCounters[counterSlot].Bytes.fetch_add(n, std::memory_order_relaxed);
+  }
+
+  void allocationTotals(uint64_t* count, uint64_t* bytes)
+  {
+    *count = 0;
+    *bytes = 0;
+    for (int i = 0; i < kMaxCounterSlots; ++i)
+    {
+      *count += allocCounters[i].Count.load(std::memory_order_relaxed);
+      *bytes += allocCounters[i].Bytes.load(std::memory_order_relaxed);
+    }
+  }
+
+  // notifications sent by the contention benchmark, they fan out to every
+  // stream and aren't responses to anything
+  char const kNotifyPrefix[] = "{\"jsonrpc\":\"2.0\",\"method\":\"bench-notify\"";
+
+  class BenchStream
+  {
+  public:
+    BenchStream(RpcServer& server, std::vector<std::string> const& requests, int offset)
+      : m_server(server)
+      , m_requests(requests)
+      , m_offset(offset)
+      , m_client(new LoopbackClient())
+      , m_have_response(false)
+      , m_notifications(0)
+    {
+      m_client->setResponseHandler([this](char const* buff, int n)
+      {
+        if (n >= static_cast<int>(sizeof(kNotifyPrefix) - 1) &&
+            strncmp(buff, kNotifyPrefix, sizeof(kNotifyPrefix) - 1) == 0)
+        {
+          m_notifications.fetch_add(1, std::memory_order_relaxed);
+          return;
+        }
+        {
+          std::lock_guard<std::mutex> lock(m_mutex);
+          m_have_response = true;
+        }
+        m_cond.notify_one();
+      });
+      m_server.addClient(m_client);
+    }
+
+    ~BenchStream()
+    {
+      m_server.removeClient(m_client);
+    }
+
+    void run(int count, std::vector<uint64_t>* latencies)
+    {
+      for (int i = 0; i < count; ++i)
+      {
+        std::string const& req = m_requests[(m_offset + i) % m_requests.size()];
+
+        auto start = std::chrono::steady_clock::now();
+        call(req);
+        auto end = std::chrono::steady_clock::now();
+
+        if (latencies)
+        {
+          std::chrono::duration<uint64_t, std::nano> elapsed = end - start;
+          latencies->push_back(elapsed.count());
+        }
+      }
+      m_offset += count;
+    }
+
+    uint64_t runUntil(std::atomic<bool> const& stop)
+    {
+      uint64_t count = 0;
+      while (!stop.load(std::memory_order_relaxed))
+      {
+        call(m_requests[(m_offset + count) % m_requests.size()]);
+        count++;
+      }
+      return count;
+    }
+
+    uint64_t notifications() const
+      { return m_notifications.load(std::memory_order_relaxed); }
+
+  private:
+    void call(std::string const& req)
+    {
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_have_response = false;
+      }
+      m_client->send(req.c_str(), static_cast<int>(req.size()));
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cond.wait(lock, [this] { return this->m_have_response; });
+      }
+    }
+
+  private:
+    RpcServer&                      m_server;
+    std::vector<std::string> const& m_requests;
+    int                             m_offset;
+    std::shared_ptr<LoopbackClient> m_client;
+    std::mutex                      m_mutex;
+    std::condition_variable         m_cond;
+    bool                            m_have_response;
+    std::atomic<uint64_t>           m_notifications;
+  };
+
+  bool loadRequests(char const* fname, std::vector<std::string>& requests)
+  {
+    std::ifstream in(fname);
+    if (!in)
+      return false;
+
+    std::string line;
+    while (std::getline(in, line))
+    {
+      if (line.empty() || line[0] == '#')
+        continue;
+      requests.push_back(line);
+    }
+    return !requests.empty();
+  }
+
+  double percentile(std::vector<uint64_t> const& sorted, double p)
+  {
+    if (sorted.empty())
+      return 0.0;
+    size_t i = static_cast<size_t>(p * sorted.size());
+    if (i >= sorted.size())
+      i = sorted.size() - 1;
+    return sorted[i] / 1000.0;
+  }
+
+  void runStreams(std::vector< std::unique_ptr<BenchStream> >& streams, int count,
+    std::vector< std::vector<uint64_t> >* latencies)
+  {
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < streams.size(); ++i)
+    {
+      BenchStream* stream = streams[i].get();
+      std::vector<uint64_t>* out = latencies ? &(*latencies)[i] : nullptr;
+      threads.push_back(std::thread([stream, count, out] { stream->run(count, out); }));
+    }
+    for (std::thread& t : threads)
+      t.join();
+  }
+
+  struct ContentionResult
+  {
+    double Inbound;
+    double Outbound;
+  };
+
+  // inbound streams send large requests in a closed loop while notifier
+  // threads push small messages out to every session. Either side can be
+  // turned off to get a baseline for the other.
+  ContentionResult runContentionPhase(RpcServer& server,
+    std::vector< std::unique_ptr<BenchStream> >& streams, int notifiers, int seconds,
+    bool inbound, bool outbound)
+  {
+    std::atomic<bool> stop(false);
+    std::atomic<uint64_t> inboundCount(0);
+    std::atomic<uint64_t> outboundCount(0);
+
+    std::vector<std::thread> threads;
+    if (inbound)
+    {
+      for (std::unique_ptr<BenchStream>& stream : streams)
+      {
+        BenchStream* p = stream.get();
+        threads.push_back(std::thread([p, &stop, &inboundCount]
+        {
+          inboundCount.fetch_add(p->runUntil(stop));
+        }));
+      }
+    }
+
+    if (outbound)
+    {
+      for (int i = 0; i < notifiers; ++i)
+      {
+        threads.push_back(std::thread([&server, &stop, &outboundCount]
+        {
+          cJSON* json = cJSON_CreateObject();
+          cJSON_AddStringToObject(json, "jsonrpc", kJsonRpcVersion);
+          cJSON_AddStringToObject(json, "method", "bench-notify");
+          cJSON_AddStringToObject(json, "status", "wpa_state=COMPLETED");
+
+          uint64_t count = 0;
+          while (!stop.load(std::memory_order_relaxed))
+          {
+            server.enqueueAsyncMessage(json);
+            count++;
+          }
+          outboundCount.fetch_add(count);
+          cJSON_Delete(json);
+        }));
+      }
+    }
+
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+    stop = true;
+    for (std::thread& t : threads)
+      t.join();
+
+    ContentionResult result;
+    result.Inbound = inboundCount.load() / static_cast<double>(seconds);
+    result.Outbound = outboundCount.load() / static_cast<double>(seconds);
+    return result;
+  }
+
+  void runContention(RpcServer& server, std::vector<std::string> const& requests,
+    int streamCount, int notifiers, int seconds)
+  {
+    std::vector< std::unique_ptr<BenchStream> > streams;
+    for (int i = 0; i < streamCount; ++i)
+      streams.push_back(std::unique_ptr<BenchStream>(new BenchStream(server, requests, 0)));
+
+    ContentionResult in = runContentionPhase(server, streams, notifiers, seconds, true, false);
+    ContentionResult out = runContentionPhase(server, streams, notifiers, seconds, false, true);
+    ContentionResult both = runContentionPhase(server, streams, notifiers, seconds, true, true);
+
+    printf("contention: streams:%d notifiers:%d request-size:%zu\n", streamCount,
+      notifiers, requests[0].size());
+    printf("inbound:    %10.1f req/s alone  %10.1f req/s with outbound   (%5.1f%%)\n",
+      in.Inbound, both.Inbound, 100.0 * both.Inbound / in.Inbound);
+    printf("outbound:   %10.1f msg/s alone  %10.1f msg/s with inbound    (%5.1f%%)\n",
+      out.Outbound, both.Outbound, 100.0 * both.Outbound / out.Outbound);
+  }
+
+  // a request with a large params payload so parsing it is a significant
+  // share of the work
+  std::string makeLargeRequest(int size)
+  {
+    std::string req = "{\"jsonrpc\":\"2.0\",\"id\":1,\"method\":\"rpc-list-services\",\"params\":{\"pad\":[";
+    int i = 0;
+    while (static_cast<int>(req.size()) < size)
+    {
+      if (i++ > 0)
+        req += ',';
+      req += "{\"ssid\":\"bench-network\",\"level\":-42,\"freq\":5745}";
+    }
+    req += "]}}";
+    return req;
+  }
+
+  void printHelp()
+  {
+    printf("\n");
+    printf("bleconfd-bench [args]\n");
+    printf("\t-c  --config   <file> Configuration file (bench/bleconfd-bench.json)\n");
+    printf("\t-r  --requests <file> JSONL file of requests (bench/requests.jsonl)\n");
+    printf("\t-s  --streams  <n>    Concurrent request streams (8)\n");
+    printf("\t-n  --count    <n>    Requests per stream (10000)\n");
+    printf("\t-w  --warmup   <n>    Unmeasured requests per stream (500)\n");
+    printf("\t-C  --contention <s> Measure inbound vs outbound interference for s seconds per phase\n");
+    printf("\t-p  --payload  <n>    Request size for --contention (32768)\n");
+    printf("\t-N  --notifiers <n>   Notification threads for --contention (2)\n");
+    printf("\t-A  --no-arena        Allocate request JSON from the heap instead of an arena\n");
+    printf("\t-v  --verbose         Keep info logging on\n");
+    printf("\t-h  --help            Print this help and exit\n");
+    exit(0);
+  }
+}
+
+extern "C"
+{
+  void* __libc_malloc(size_t n);
+  void* __libc_calloc(size_t n, size_t size);
+  void* __libc_realloc(void* p, size_t n);
+
+  void* malloc(size_t n)
+  {
+    countAllocation(n);
+    return __libc_malloc(n);
+  }
+
+  void* calloc(size_t n, size_t size)
+  {
+    countAllocation(n * size);
+    return __libc_calloc(n, size);
+  }
+
+  void* realloc(void* p, size_t n)
+  {
+    countAllocation(n);
+    return __libc_realloc(p, n);
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  std::string configFile = "bench/bleconfd-bench.json";
+  std::string requestFile = "bench/requests.jsonl";
+  int streamCount = 8;
+  int count = 10000;
+  int warmup = 500;
+  int contention = 0;
+  int payload = 32768;
+  int notifiers = 2;
+  bool useArena = true;
+  RpcLogLevel logLevel = RpcLogLevel::Warning;
+
+  JsonArena::installHooks();
+
+  while (true)
+  {
+    static struct option longOptions[] =
+    {
+      { "config",   required_argument, 0, 'c' },
+      { "requests", required_argument, 0, 'r' },
+      { "streams",  required_argument, 0, 's' },
+      { "count",    required_argument, 0, 'n' },
+      { "warmup",   required_argument, 0, 'w' },
+      { "contention", required_argument, 0, 'C' },
+      { "payload",  required_argument, 0, 'p' },
+      { "notifiers", required_argument, 0, 'N' },
+      { "no-arena", no_argument, 0, 'A' },
+      { "verbose",  no_argument, 0, 'v' },
+      { "help",     no_argument, 0, 'h' },
+      { 0, 0, 0, 0 }
+    };
+
+    int optionIndex = 0;
+    int c = getopt_long(argc, argv, "c:r:s:n:w:C:p:N:Avh", longOptions, &optionIndex);
+    if (c == -1)
+      break;
+
+    switch (c)
+    {
+      case 'c':
+        configFile = optarg;
+        break;
+      case 'r':
+        requestFile = optarg;
+        break;
+      case 's':
+        streamCount = std::max(1, atoi(optarg));
+        break;
+      case 'n':
+        count = std::max(1, atoi(optarg));
+        break;
+      case 'w':
+        warmup = std::max(0, atoi(optarg));
+        break;
+      case 'C':
+        contention = std::max(0, atoi(optarg));
+        break;
+      case 'p':
+        payload = std::max(64, atoi(optarg));
+        break;
+      case 'N':
+        notifiers = std::max(1, atoi(optarg));
+        break;
+      case 'A':
+        useArena = false;
+        break;
+      case 'v':
+        logLevel = RpcLogLevel::Info;
+        break;
+      case 'h':
+        printHelp();
+        break;
+      default:
+        break;
+    }
+  }
+
+  RpcLogger::logger().setLevel(logLevel);
+
+  cJSON* config = JsonRpc::fromFile(configFile.c_str());
+  if (!config)
+  {
+    fprintf(stderr, "failed to load configuration file from:%s\n", configFile.c_str());
+    return 1;
+  }
+
+  if (!useArena)
+  {
+    cJSON* server = cJSON_GetObjectItem(config, "server");
+    if (!server)
+    {
+      server = cJSON_CreateObject();
+      cJSON_AddItemToObject(config, "server", server);
+    }
+    cJSON_DeleteItemFromObject(server, "json-arena");
+    cJSON_AddFalseToObject(server, "json-arena");
+  }
+
+  std::vector<std::string> requests;
+  if (contention > 0)
+  {
+    requests.push_back(makeLargeRequest(payload));
+  }
+  else if (!loadRequests(requestFile.c_str(), requests))
+  {
+    fprintf(stderr, "failed to load requests from:%s\n", requestFile.c_str());
+    cJSON_Delete(config);
+    return 1;
+  }
+
+  int workerThreads = JsonRpc::getInt(config, "/server/worker-threads", false, 0);
+
+  if (contention > 0)
+  {
+    RpcServer server(configFile, config);
+    runContention(server, requests, streamCount, notifiers, contention);
+  }
+  else
+  {
+    RpcServer server(configFile, config);
+
+    std::vector< std::unique_ptr<BenchStream> > streams;
+    for (int i = 0; i < streamCount; ++i)
+    {
+      // spread the streams across the file so they aren't all sending the
+      // same method at the same time
+      int offset = static_cast<int>((requests.size() * i) / streamCount);
+      streams.push_back(std::unique_ptr<BenchStream>(new BenchStream(server, requests, offset)));
+    }
+
+    if (warmup > 0)
+      runStreams(streams, warmup, nullptr);
+
+    std::vector< std::vector<uint64_t> > latencies(streamCount);
+    for (std::vector<uint64_t>& v : latencies)
+      v.reserve(count);
+
+    uint64_t allocsBefore = 0;
+    uint64_t bytesBefore = 0;
+    allocationTotals(&allocsBefore, &bytesBefore);
+
+    auto start = std::chrono::steady_clock::now();
+    runStreams(streams, count, &latencies);
+    auto end = std::chrono::steady_clock::now();
+
+    uint64_t allocsAfter = 0;
+    uint64_t bytesAfter = 0;
+    allocationTotals(&allocsAfter, &bytesAfter);
+
+    std::vector<uint64_t> all;
+    all.reserve(static_cast<size_t>(streamCount) * count);
+    for (std::vector<uint64_t> const& v : latencies)
+      all.insert(all.end(), v.begin(), v.end());
+    std::sort(all.begin(), all.end());
+
+    std::chrono::duration<double> elapsed = end - start;
+    double total = static_cast<double>(all.size());
+
+    printf("streams:%d requests:%zu workers:%d request-file:%s (%zu requests)\n",
+      streamCount, all.size(), workerThreads, requestFile.c_str(), requests.size());
+    printf("throughput: %10.1f req/s\n", total / elapsed.count());
+    printf("latency:    p50:%9.1fus  p99:%9.1fus  p999:%9.1fus  max:%9.1fus\n",
+      percentile(all, 0.50), percentile(all, 0.99), percentile(all, 0.999),
+      all.empty() ? 0.0 : all.back() / 1000.0);
+    printf("allocs:     %10.1f per request  %10.1f bytes per request\n",
+      (allocsAfter - allocsBefore) / total, (bytesAfter - bytesBefore) / total);
+  }
+
+  rusage usage;
+  memset(&usage, 0, sizeof(usage));
+  getrusage(RUSAGE_SELF, &usage);
+  printf("memory:     peak-rss:%ld KB  json-arena:%s\n", usage.ru_maxrss,
+    useArena ? "on" : "off");
+
+  cJSON_Delete(config);
+  return 0;
+}
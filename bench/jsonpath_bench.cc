@@ -0,0 +1,129 @@
+//
+// Copyright [2018] [Comcast, Corp]
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#include "../jsonpath.h"
+
+#include <chrono>
+#include <string>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cJSON.h>
+
+namespace
+{
+  // what JsonRpc::search did before paths were compiled, a strdup and a
+  // strtok_r walk on every call
+  cJSON const* legacySearch(cJSON const* json, char const* name)
+  {
+    cJSON const* item = nullptr;
+    if (name[0] == '/')
+    {
+      char* str = strdup(name + 1);
+      char* copy = str;
+      char* saveptr = nullptr;
+      char* token = nullptr;
+
+      item = json;
+      while ((token = strtok_r(str, "/", &saveptr)) != nullptr)
+      {
+        item = cJSON_GetObjectItem(item, token);
+        if (!item)
+          break;
+        str = nullptr;
+      }
+      free(copy);
+    }
+    else
+    {
+      item = cJSON_GetObjectItem(json, name);
+    }
+    return item;
+  }
+
+  template<class F>
+  double nsPerLookup(F const& lookup, int iterations)
+  {
+    // the volatile sink keeps the lookups from being optimized away
+    cJSON const* volatile sink = nullptr;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i)
+      sink = lookup();
+    auto end = std::chrono::steady_clock::now();
+
+    (void) sink;
+    std::chrono::duration<double, std::nano> elapsed = end - start;
+    return elapsed.count() / iterations;
+  }
+
+  void runCase(cJSON const* json, char const* path, bool legacy, int iterations)
+  {
+    JsonPath compiled(path);
+    if (compiled.find(json) != JsonPath::find(json, path))
+    {
+      printf("%-50s compiled and uncompiled lookups disagree\n", path);
+      exit(1);
+    }
+
+    double uncompiledNs = nsPerLookup([&] { return JsonPath::find(json, path); }, iterations);
+    double compiledNs = nsPerLookup([&] { return compiled.find(json); }, iterations);
+
+    if (legacy)
+    {
+      double legacyNs = nsPerLookup([&] { return legacySearch(json, path); }, iterations);
+      printf("%-50s strtok:%8.1f ns  uncompiled:%8.1f ns  compiled:%8.1f ns  speedup:%5.1fx\n",
+        path, legacyNs, uncompiledNs, compiledNs, legacyNs / compiledNs);
+    }
+    else
+    {
+      printf("%-50s strtok:     n/a     uncompiled:%8.1f ns  compiled:%8.1f ns\n",
+        path, uncompiledNs, compiledNs);
+    }
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  int iterations = 1000000;
+  if (argc > 1)
+    iterations = static_cast<int>(strtol(argv[1], nullptr, 10));
+
+  // a wifi-connect request and a configuration shaped like bleconfd.json
+  cJSON* request = cJSON_Parse(
+    "{\"jsonrpc\":\"2.0\",\"id\":12,\"method\":\"wifi-connect\",\"params\":{"
+    "\"discovery\":{\"ssid\":\"home-network\",\"bssid\":\"00:11:22:33:44:55\"},"
+    "\"cred\":{\"key-mgmt\":\"wpa-psk\",\"pass\":\"secret\"},\"key\":\"mac\"}}");
+  cJSON* config = cJSON_Parse(
+    "{\"server\":{\"worker-threads\":4},\"listener\":{\"name\":\"ble\"},\"services\":["
+    "{\"name\":\"wifi\",\"settings\":{\"interface\":\"/var/run/wpa_supplicant/wlan0\"}},"
+    "{\"name\":\"config\",\"settings\":{\"db-file\":\"bleconfd.ini\"}},"
+    "{\"name\":\"cmd\",\"settings\":{\"commands\":[{\"name\":\"ls\"},{\"name\":\"reboot\"}]}},"
+    "{\"name\":\"net\"}]}");
+
+  runCase(request, "id", true, iterations);
+  runCase(request, "/params/key", true, iterations);
+  runCase(request, "/params/cred/pass", true, iterations);
+  runCase(request, "/params/discovery/ssid", true, iterations);
+  runCase(config, "/server/worker-threads", true, iterations);
+  runCase(config, "/services[@name='net']", false, iterations);
+  runCase(config, "/services[@name='cmd']/settings/commands[1]/name", false, iterations);
+
+  cJSON_Delete(request);
+  cJSON_Delete(config);
+  return 0;
+}
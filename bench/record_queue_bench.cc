@@ -0,0 +1,96 @@
+//
+// Copyright [2018] [Comcast, Corp]
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#include "../memory_stream.h"
+#include "../record_queue.h"
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+namespace
+{
+  char const kRecordDelimiter {30};
+
+  // mirrors the GATT read path, a response is pushed once and then drained
+  // with fixed size reads
+  template<class Q>
+  double runOnce(Q& q, std::string const& response, int reads_per_put, int iterations,
+    int read_size)
+  {
+    std::vector<char> buff(read_size);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i)
+    {
+      q.put_line(response.c_str(), static_cast<int>(response.size()));
+      for (int j = 0; j < reads_per_put; ++j)
+      {
+        if (q.size() == 0)
+          break;
+        q.get_line(&buff[0], read_size);
+      }
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    // drain anything left over so each run starts empty
+    while (q.size() > 0)
+      q.get_line(&buff[0], read_size);
+
+    std::chrono::duration<double, std::nano> elapsed = end - start;
+    return elapsed.count() / iterations;
+  }
+
+  void runCase(char const* name, size_t response_size, int iterations, int read_size)
+  {
+    std::string response(response_size, 'x');
+    int reads_per_put = static_cast<int>((response_size + 1 + read_size - 1) / read_size);
+
+    memory_stream stream(kRecordDelimiter);
+    record_queue queue(kRecordDelimiter);
+
+    // warm up
+    runOnce(stream, response, reads_per_put, iterations / 10 + 1, read_size);
+    runOnce(queue, response, reads_per_put, iterations / 10 + 1, read_size);
+
+    double old_ns = runOnce(stream, response, reads_per_put, iterations, read_size);
+    double new_ns = runOnce(queue, response, reads_per_put, iterations, read_size);
+
+    printf("%-8s size:%6zu read:%4d  memory_stream:%10.1f ns/response  "
+      "record_queue:%10.1f ns/response  speedup:%6.1fx\n",
+      name, response_size, read_size, old_ns, new_ns, old_ns / new_ns);
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  int iterations = 20000;
+  if (argc > 1)
+    iterations = static_cast<int>(strtol(argv[1], nullptr, 10));
+
+  // typical small responses (config-get, wifi-get-status) and a large
+  // wifi-scan sized response, read back at the legacy 256 byte buffer size
+  // and at a 247 byte MTU segment size
+  runCase("small", 64, iterations, 256);
+  runCase("small", 512, iterations, 256);
+  runCase("large", 6 * 1024, iterations / 4, 256);
+  runCase("large", 6 * 1024, iterations / 4, 246);
+  runCase("large", 64 * 1024, iterations / 40, 246);
+
+  return 0;
+}
@@ -0,0 +1,186 @@
+//
+// Copyright [2018] [Comcast, Corp]
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#include "../defs.h"
+#include "../jsonrpc.h"
+#include "../rpcserver.h"
+#include "../rpcstream.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <cJSON.h>
+
+// Stand-ins for the wifi and cmd services so the benchmark runs on any box.
+// They register under the same names and return responses shaped like the
+// real ones without touching wpa_supplicant or spawning processes.
+namespace
+{
+  int const kDefaultScanResults = 16;
+
+  // same params as the real services so the benchmark pays for binding
+  struct ConnectParams
+  {
+    struct Discovery
+    {
+      char const* Ssid;
+      static RpcParams<Discovery> const& params()
+      {
+        static RpcParams<Discovery> const p = RpcParams<Discovery>()
+          .field("ssid", &Discovery::Ssid);
+        return p;
+      }
+    };
+
+    struct Credentials
+    {
+      char const* Pass;
+      static RpcParams<Credentials> const& params()
+      {
+        static RpcParams<Credentials> const p = RpcParams<Credentials>()
+          .field("pass", &Credentials::Pass);
+        return p;
+      }
+    };
+
+    Discovery   Disc;
+    Credentials Cred;
+    static RpcParams<ConnectParams> const& params()
+    {
+      static RpcParams<ConnectParams> const p = RpcParams<ConnectParams>()
+        .field("discovery", &ConnectParams::Disc)
+        .field("cred", &ConnectParams::Cred);
+      return p;
+    }
+  };
+
+  struct ExecParams
+  {
+    char const*   CommandName;
+    cJSON const*  Args;
+    static RpcParams<ExecParams> const& params()
+    {
+      static RpcParams<ExecParams> const p = RpcParams<ExecParams>()
+        .field("command_name", &ExecParams::CommandName)
+        .field("args", &ExecParams::Args, false);
+      return p;
+    }
+  };
+
+  class StubWiFiService : public BasicRpcService
+  {
+  public:
+    StubWiFiService()
+      : BasicRpcService("wifi")
+      , m_scan_results(kDefaultScanResults) { }
+
+    virtual void init(cJSON const* conf, RpcNotificationFunction const& callback) override
+    {
+      BasicRpcService::init(conf, callback);
+      m_scan_results = JsonRpc::getInt(conf, "/settings/scan-results", false, kDefaultScanResults);
+
+      registerMethod("get-status", [this](cJSON const* req) -> cJSON* { return this->getStatus(req); },
+        RpcConcurrency::Parallel);
+      registerMethod<ConnectParams>("connect",
+        [this](ConnectParams const& params, cJSON const* UNUSED_PARAM(req)) -> cJSON*
+          { return this->connect(params); });
+      registerMethod("scan", [this](cJSON const* req) -> cJSON* { return this->scan(req); });
+    }
+
+  private:
+    cJSON* getStatus(cJSON const* UNUSED_PARAM(req))
+    {
+      cJSON* res = cJSON_CreateObject();
+      cJSON_AddStringToObject(res, "bssid", "10:da:43:9c:12:6e");
+      cJSON_AddStringToObject(res, "freq", "5745");
+      cJSON_AddStringToObject(res, "ssid", "bench-network");
+      cJSON_AddStringToObject(res, "id", "0");
+      cJSON_AddStringToObject(res, "mode", "station");
+      cJSON_AddStringToObject(res, "pairwise_cipher", "CCMP");
+      cJSON_AddStringToObject(res, "group_cipher", "CCMP");
+      cJSON_AddStringToObject(res, "key_mgmt", "WPA2-PSK");
+      cJSON_AddStringToObject(res, "wpa_state", "COMPLETED");
+      cJSON_AddStringToObject(res, "ip_address", "192.168.1.23");
+      cJSON_AddStringToObject(res, "address", "b8:27:eb:01:02:03");
+      return res;
+    }
+
+    cJSON* connect(ConnectParams const& UNUSED_PARAM(params))
+    {
+      return cJSON_CreateString("ok");
+    }
+
+    cJSON* scan(cJSON const* req)
+    {
+      cJSON* head = cJSON_CreateObject();
+      cJSON_AddStringToObject(head, "status", "scan-done");
+      std::unique_ptr<RpcResponseStream> stream = openResponseStream(req);
+      stream->begin(head, "results");
+      cJSON_Delete(head);
+
+      for (int i = 0; i < m_scan_results; ++i)
+      {
+        char buff[64];
+        int n = 0;
+        stream->beginItem();
+
+        n = snprintf(buff, sizeof(buff), "10:da:43:9c:%02x:%02x", (i >> 8) & 0xff, i & 0xff);
+        stream->addString("bssid", buff, n);
+        stream->addString("freq", (i % 2) ? "2437" : "5745", 4);
+        n = snprintf(buff, sizeof(buff), "-%d", 40 + (i % 50));
+        stream->addString("level", buff, n);
+        stream->addString("flags", "[WPA2-PSK-CCMP][ESS]", 20);
+        n = snprintf(buff, sizeof(buff), "bench-network-%d", i);
+        stream->addString("ssid", buff, n);
+
+        stream->endItem();
+      }
+      return stream->finish();
+    }
+
+  private:
+    int m_scan_results;
+  };
+
+  class StubShellService : public BasicRpcService
+  {
+  public:
+    StubShellService()
+      : BasicRpcService("cmd") { }
+
+    virtual void init(cJSON const* conf, RpcNotificationFunction const& callback) override
+    {
+      BasicRpcService::init(conf, callback);
+      registerMethod<ExecParams>("exec",
+        [this](ExecParams const& params, cJSON const* UNUSED_PARAM(req)) -> cJSON*
+          { return this->executeCommand(params); },
+        RpcConcurrency::Parallel);
+    }
+
+  private:
+    cJSON* executeCommand(ExecParams const& params)
+    {
+      char const* commandName = params.CommandName;
+
+      cJSON* res = cJSON_CreateObject();
+      cJSON_AddItemToObject(res, "return_code", cJSON_CreateNumber(0));
+      cJSON_AddItemToObject(res, "stdout", cJSON_CreateString(commandName));
+      return res;
+    }
+  };
+}
+
+JSONRPC_SERVICE_DEFINE(wifi, []{return new StubWiFiService();});
+JSONRPC_SERVICE_DEFINE(cmd, []{return new StubShellService();});
@@ -0,0 +1,354 @@
+//
+// Copyright [2018] [Comcast, Corp]
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#include "../services/bsstable.h"
+#include "../services/wpareply.h"
+
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cJSON.h>
+
+namespace
+{
+  // STATUS as wpa_supplicant sends it for a station associated to a WPA2
+  // access point
+  char const kStatusReply[] =
+    "bssid=a0:63:91:2b:9e:65\n"
+    "freq=5180\n"
+    "ssid=home-network\n"
+    "id=0\n"
+    "mode=station\n"
+    "wifi_generation=5\n"
+    "pairwise_cipher=CCMP\n"
+    "group_cipher=CCMP\n"
+    "key_mgmt=WPA2-PSK\n"
+    "wpa_state=COMPLETED\n"
+    "ip_address=192.168.1.23\n"
+    "p2p_device_address=b8:27:eb:4f:1c:8a\n"
+    "address=b8:27:eb:4f:1c:8a\n"
+    "uuid=e2a8c3d4-6f1b-5a3e-9c1d-0b27eb4f1c8a\n"
+    "ieee80211ac=1\n";
+
+  // one page of BSS RANGE=0- MASK=0x21a87, the fields the wifi service asks
+  // for, from a scan in a busy building
+  char const kBssReply[] =
+    "id=0\nbssid=a0:63:91:2b:9e:65\nfreq=5180\nlevel=-48\nage=3\n"
+    "flags=[WPA2-PSK-CCMP][WPS][ESS]\nssid=home-network\n====\n"
+    "id=1\nbssid=a0:63:91:2b:9e:64\nfreq=2437\nlevel=-41\nage=3\n"
+    "flags=[WPA2-PSK-CCMP][WPS][ESS]\nssid=home-network\n====\n"
+    "id=2\nbssid=f4:f2:6d:71:0a:3c\nfreq=2412\nlevel=-67\nage=3\n"
+    "flags=[WPA-PSK-CCMP+TKIP][WPA2-PSK-CCMP+TKIP][ESS]\nssid=TP-LINK_0A3C\n====\n"
+    "id=4\nbssid=3c:37:86:5e:21:d0\nfreq=2462\nlevel=-72\nage=4\n"
+    "flags=[WPA2-PSK-CCMP][ESS]\nssid=NETGEAR47\n====\n"
+    "id=5\nbssid=3e:37:86:5e:21:d1\nfreq=2462\nlevel=-73\nage=4\n"
+    "flags=[ESS]\nssid=NETGEAR47-Guest\n====\n"
+    "id=7\nbssid=00:1d:aa:c4:88:10\nfreq=5745\nlevel=-78\nage=3\n"
+    "flags=[WPA2-EAP-CCMP][ESS]\nssid=corp-secure\n====\n"
+    "id=8\nbssid=00:1d:aa:c4:88:11\nfreq=5745\nlevel=-79\nage=3\n"
+    "flags=[WPA2-PSK-CCMP][ESS]\nssid=corp-guest\n====\n"
+    "id=9\nbssid=b0:be:76:9a:02:7f\nfreq=2437\nlevel=-84\nage=5\n"
+    "flags=[WPA2-PSK-CCMP][WPS][ESS]\nssid=\\xe2\\x98\\x95 cafe\n====\n"
+    "id=11\nbssid=c8:d7:19:33:e0:41\nfreq=2422\nlevel=-86\nage=5\n"
+    "flags=[WEP][ESS]\nssid=linksys\n====\n"
+    "id=12\nbssid=92:2a:a8:10:6c:fe\nfreq=5220\nlevel=-88\nage=5\n"
+    "flags=[WPA2-PSK-CCMP][ESS][P2P]\nssid=DIRECT-fe-HP OfficeJet\n====\n";
+
+  std::atomic<long> allocations(0);
+
+  void* countingMalloc(size_t n)
+  {
+    allocations++;
+    return malloc(n);
+  }
+
+  // what wpaControl_createResponse did, a substring for the line and two
+  // more for its name and value
+  cJSON* legacyCreateResponse(std::string const& s)
+  {
+    cJSON* res = nullptr;
+
+    if (!s.empty())
+    {
+      res = cJSON_CreateObject();
+
+      size_t begin = 0;
+      while (true)
+      {
+        size_t end = s.find('\n', begin);
+        if (end == std::string::npos)
+          break;
+
+        std::string line(s.substr(begin, (end - begin)));
+        size_t mid = line.find('=');
+
+        if (mid != std::string::npos)
+        {
+          std::string name(line.substr(0, mid));
+          std::string value(line.substr(mid + 1));
+
+          cJSON_AddItemToObject(res, name.c_str(), cJSON_CreateString(value.c_str()));
+        }
+
+        begin = end + 1;
+      }
+    }
+
+    return res;
+  }
+
+  // what BssTable::parse did, a std::string for every value
+  int legacyParseBss(std::string const& reply, BssTable::clock::time_point now,
+    std::vector<BssEntry>& entries)
+  {
+    int lastId = -1;
+    bool inEntry = false;
+
+    size_t begin = 0;
+    while (begin < reply.size())
+    {
+      size_t end = reply.find('\n', begin);
+      if (end == std::string::npos)
+        end = reply.size();
+
+      char const* line = reply.c_str() + begin;
+      size_t n = end - begin;
+
+      if (n == 4 && strncmp(line, "====", 4) == 0)
+      {
+        inEntry = false;
+      }
+      else
+      {
+        char const* mid = static_cast<char const *>(memchr(line, '=', n));
+        if (mid)
+        {
+          if (!inEntry)
+          {
+            entries.push_back(BssEntry());
+            entries.back().LastSeen = now;
+          }
+          inEntry = true;
+
+          BssEntry& entry = entries.back();
+          size_t nameLength = mid - line;
+          std::string value(mid + 1, line + n);
+
+          if (nameLength == 2 && strncmp(line, "id", 2) == 0)
+          {
+            entry.Id = static_cast<int>(strtol(value.c_str(), nullptr, 10));
+            lastId = entry.Id;
+          }
+          else if (nameLength == 5 && strncmp(line, "bssid", 5) == 0)
+            entry.Bssid = std::move(value);
+          else if (nameLength == 4 && strncmp(line, "freq", 4) == 0)
+            entry.Freq = std::move(value);
+          else if (nameLength == 5 && strncmp(line, "level", 5) == 0)
+            entry.Level = std::move(value);
+          else if (nameLength == 5 && strncmp(line, "flags", 5) == 0)
+            entry.Flags = std::move(value);
+          else if (nameLength == 4 && strncmp(line, "ssid", 4) == 0)
+            entry.Ssid = std::move(value);
+          else if (nameLength == 3 && strncmp(line, "age", 3) == 0)
+            entry.LastSeen = now - std::chrono::seconds(strtol(value.c_str(), nullptr, 10));
+        }
+      }
+
+      begin = end + 1;
+    }
+
+    return lastId;
+  }
+
+  struct Result
+  {
+    double NsPerReply;
+    double AllocationsPerReply;
+  };
+
+  template<class F>
+  Result measure(F const& parse, int iterations)
+  {
+    long before = allocations;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i)
+      parse();
+    auto end = std::chrono::steady_clock::now();
+
+    std::chrono::duration<double, std::nano> elapsed = end - start;
+
+    Result r;
+    r.NsPerReply = elapsed.count() / iterations;
+    r.AllocationsPerReply = static_cast<double>(allocations - before) / iterations;
+    return r;
+  }
+
+  void report(char const* name, Result const& legacy, Result const& current)
+  {
+    printf("%-28s legacy:%8.1f ns %5.1f allocs  tokenized:%8.1f ns %5.1f allocs  speedup:%5.1fx\n",
+      name, legacy.NsPerReply, legacy.AllocationsPerReply, current.NsPerReply,
+      current.AllocationsPerReply, legacy.NsPerReply / current.NsPerReply);
+  }
+
+  std::string toString(cJSON const* json)
+  {
+    char* s = cJSON_PrintUnformatted(json);
+    std::string str(s);
+    cJSON_free(s);
+    return str;
+  }
+
+  void runStatusCase(char const* name, cJSON const* fields, int iterations)
+  {
+    std::string const reply(kStatusReply);
+
+    // the reply is split in place, so each pass starts from a fresh copy. The
+    // buffer is reused so the copy doesn't allocate
+    std::string buff;
+    buff.reserve(reply.size());
+
+    buff = reply;
+    cJSON* expected = legacyCreateResponse(reply);
+    cJSON* actual = WpaReply::toJson(buff, fields);
+    if (!fields && toString(expected) != toString(actual))
+    {
+      printf("%-28s legacy and tokenized replies disagree\n", name);
+      exit(1);
+    }
+    cJSON_Delete(expected);
+    cJSON_Delete(actual);
+
+    Result legacy = measure([&]
+    {
+      cJSON* json = legacyCreateResponse(reply);
+      if (fields)
+      {
+        // the closest the old code came to selecting fields
+        cJSON* selected = cJSON_CreateObject();
+        for (cJSON const* f = fields->child; f; f = f->next)
+        {
+          cJSON* item = cJSON_DetachItemFromObject(json, f->valuestring);
+          if (item)
+            cJSON_AddItemToObject(selected, f->valuestring, item);
+        }
+        cJSON_Delete(json);
+        json = selected;
+      }
+      cJSON_Delete(json);
+    }, iterations);
+
+    Result current = measure([&]
+    {
+      buff.assign(reply);
+      cJSON_Delete(WpaReply::toJson(buff, fields));
+    }, iterations);
+
+    report(name, legacy, current);
+  }
+
+  void runBssCase(int iterations)
+  {
+    std::string const reply(kBssReply);
+    BssTable::clock::time_point now = BssTable::clock::now();
+
+    std::string buff;
+    buff.reserve(reply.size());
+
+    std::vector<BssEntry> expected;
+    std::vector<BssEntry> actual;
+    legacyParseBss(reply, now, expected);
+    buff = reply;
+    BssTable::parse(buff, now, actual);
+
+    bool same = expected.size() == actual.size();
+    for (size_t i = 0; same && i < expected.size(); ++i)
+    {
+      same = expected[i].Id == actual[i].Id && expected[i].Bssid == actual[i].Bssid &&
+        expected[i].Freq == actual[i].Freq && expected[i].Level == actual[i].Level &&
+        expected[i].Flags == actual[i].Flags && expected[i].Ssid == actual[i].Ssid &&
+        expected[i].LastSeen == actual[i].LastSeen;
+    }
+    if (!same)
+    {
+      printf("%-28s legacy and tokenized entries disagree\n", "BSS RANGE");
+      exit(1);
+    }
+
+    // entries are kept as strings either way, what's measured is the
+    // temporaries made on the way there
+    std::vector<BssEntry> entries;
+    entries.reserve(expected.size());
+
+    Result legacy = measure([&]
+    {
+      entries.clear();
+      legacyParseBss(reply, now, entries);
+    }, iterations);
+
+    Result current = measure([&]
+    {
+      entries.clear();
+      buff.assign(reply);
+      BssTable::parse(buff, now, entries);
+    }, iterations);
+
+    char name[64];
+    snprintf(name, sizeof(name), "BSS RANGE (%zu entries)", expected.size());
+    report(name, legacy, current);
+  }
+}
+
+void* operator new(size_t n)
+{
+  allocations++;
+  void* p = malloc(n ? n : 1);
+  if (!p)
+    throw std::bad_alloc();
+  return p;
+}
+
+void operator delete(void* p) noexcept
+{
+  free(p);
+}
+
+int main(int argc, char* argv[])
+{
+  int iterations = 200000;
+  if (argc > 1)
+    iterations = static_cast<int>(strtol(argv[1], nullptr, 10));
+
+  cJSON_Hooks hooks;
+  hooks.malloc_fn = &countingMalloc;
+  hooks.free_fn = &free;
+  cJSON_InitHooks(&hooks);
+
+  cJSON* fields = cJSON_Parse("[\"wpa_state\",\"ssid\"]");
+
+  runStatusCase("STATUS", nullptr, iterations);
+  runStatusCase("STATUS wpa_state,ssid", fields, iterations);
+  runBssCase(iterations);
+
+  cJSON_Delete(fields);
+  return 0;
+}
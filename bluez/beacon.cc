@@ -462,3 +462,14 @@ startBeacon(std::string const& name, int deviceId)
   cmdLeadv(deviceInfo.dev_id);
   cmdName(deviceInfo.dev_id, name.c_str());
 }
+
+/**
+ * turn LE advertising back on
+ * @param deviceId the hci device id
+ */
+void
+resumeBeacon(int deviceId)
+{
+  XLOG_INFO("resuming beacon on hci%d", deviceId);
+  cmdLeadv(deviceId);
+}
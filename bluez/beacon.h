@@ -26,4 +26,11 @@ struct cJSON;
  */
 void startBeacon(std::string const& name, int deviceId);
 
+/**
+ * turn LE advertising back on after the controller stopped it for an
+ * incoming connection
+ * @param deviceId the hci device id
+ */
+void resumeBeacon(int deviceId);
+
 #endif
@@ -19,7 +19,9 @@
 #include "../rpclogger.h"
 #include "../util.h"
 #include "../jsonrpc.h"
+#include "../reactor.h"
 
+#include <algorithm>
 #include <exception>
 #include <fstream>
 #include <sstream>
@@ -30,6 +32,7 @@
 #include <fcntl.h>
 #include <stdarg.h>
 #include <unistd.h>
+#include <sys/eventfd.h>
 #include <cJSON.h>
 
 // these are pulled directly from the BlueZ source tree
@@ -58,6 +61,23 @@ namespace
   std::string const kUuidRpcInbox         {"510c87c8-eb90-11e8-b3dc-17292c2ecc2d"};
   std::string const kUuidRpcEPoll         {"5140f882-eb90-11e8-a835-13d2bd922d3f"};
 
+  // values a client can write to the EPoll characteristic to pick how
+  // responses are delivered on that connection
+  uint8_t const kDeliveryModePoll         {0};
+  uint8_t const kDeliveryModePush         {1};
+
+  // how often closed clients that a worker still holds are checked again,
+  // in milliseconds
+  int const kReapRetryInterval            {250};
+
+  // ATT notification header is opcode + handle
+  uint16_t const kNotificationHeaderSize  {3};
+
+  // push mode notifications handed to the att but not yet written to the
+  // socket. Holding the rest back in the outgoing queue keeps its size, and
+  // so waitForSendSpace, honest about what the client hasn't received
+  int const kMaxNotificationsInFlight     {4};
+
   void DIS_writeCallback(gatt_db_attribute* UNUSED_PARAM(attr), int err, void* UNUSED_PARAM(argp))
   {
     if (err)
@@ -66,9 +86,6 @@ namespace
     }
   }
 
-  void throw_errno(int err, char const* fmt, ...)
-    __attribute__ ((format (printf, 2, 3)));
-
   void ATT_debugCallback(char const* str, void* UNUSED_PARAM(argp))
   {
     if (!str)
@@ -85,33 +102,6 @@ namespace
       XLOG_DEBUG("GATT: %s", str);
   }
 
-  void throw_errno(int e, char const* fmt, ...)
-  {
-    char buff[256] = {0};
-
-    va_list args;
-    va_start(args, fmt);
-    vsnprintf(buff, sizeof(buff), fmt, args);
-    buff[sizeof(buff) - 1] = '\0';
-    va_end(args);
-
-    char err[256] = {0};
-    char* p = strerror_r(e, err, sizeof(err));
-
-    std::stringstream out;
-    if (strlen(buff) > 0)
-    {
-      out << buff;
-      out << ". ";
-    }
-    if (p && strlen(p) > 0)
-      out << p;
-
-    std::string message(out.str());
-    XLOG_ERROR("exception:%s", message.c_str());
-    throw std::runtime_error(message);
-  }
-
   void GattClient_onGapRead(gatt_db_attribute* attr, uint32_t id, uint16_t offset,
     uint8_t opcode, bt_att* att, void* argp)
   {
@@ -167,6 +157,13 @@ namespace
     clnt->onEPollRead(attr, id, offset, opcode, att);
   }
 
+  void GattClient_onEPollWrite(gatt_db_attribute* attr, uint32_t id, uint16_t offset,
+    uint8_t const* data, size_t len, uint8_t opcode, bt_att* att, void* argp)
+  {
+    GattClient* clnt = reinterpret_cast<GattClient *>(argp);
+    clnt->onEPollWrite(attr, id, offset, data, len, opcode, att);
+  }
+
   void GattClient_onDataChannelIn(gatt_db_attribute* attr, uint32_t id, uint16_t offset,
     uint8_t const* data, size_t len, uint8_t opcode, bt_att* att, void* argp)
   {
@@ -186,18 +183,62 @@ namespace
     GattClient* clnt = reinterpret_cast<GattClient *>(argp);
     clnt->onTimeout();
   }
+
+  void GattClient_onWakeup(int UNUSED_PARAM(fd), uint32_t events, void* argp)
+  {
+    GattClient* clnt = reinterpret_cast<GattClient *>(argp);
+    clnt->onWakeup(events);
+  }
+
+  void GattClient_onNotificationSent(void* argp)
+  {
+    GattClient* clnt = reinterpret_cast<GattClient *>(argp);
+    clnt->onNotificationSent();
+  }
+
+  void GattServer_onAcceptReady(int UNUSED_PARAM(fd), uint32_t UNUSED_PARAM(events), void* argp)
+  {
+    GattServer* server = reinterpret_cast<GattServer *>(argp);
+    server->onAcceptReady();
+  }
+
+  void GattServer_onReapTimeout(int UNUSED_PARAM(id), void* argp)
+  {
+    GattServer* server = reinterpret_cast<GattServer *>(argp);
+    server->onReapTimeout();
+  }
+
+  void GattServer_onReactorReady(int UNUSED_PARAM(fd), uint32_t UNUSED_PARAM(events),
+    void* UNUSED_PARAM(argp))
+  {
+    Reactor::main().runOnce(0);
+  }
 }
 
 GattServer::GattServer()
   : m_listen_fd(-1)
+  , m_poll_interval(0)
+  , m_max_mtu(BT_ATT_MAX_LE_MTU)
+  , m_max_clients(4)
+  , m_hci_device_id(0)
+  , m_reap_timeout_id(-1)
 {
   memset(&m_local_interface, 0, sizeof(m_local_interface));
 }
 
 GattServer::~GattServer()
 {
+  if (m_reap_timeout_id != -1)
+    mainloop_remove_timeout(m_reap_timeout_id);
+
+  m_clients.clear();
+  m_closed_clients.clear();
+
   if (m_listen_fd != -1)
+  {
+    mainloop_remove_fd(m_listen_fd);
     close(m_listen_fd);
+  }
 }
 
 void
@@ -226,37 +267,159 @@ GattServer::init(cJSON const* conf)
   if (ret < 0)
     throw_errno(errno, "failed to set security on bluetooth socket");
 
-  ret = listen(m_listen_fd, 2);
+  m_max_clients = JsonRpc::getInt(conf, "max-clients", false, 4);
+  if (m_max_clients < 1)
+    m_max_clients = 1;
+
+  ret = listen(m_listen_fd, m_max_clients);
   if (ret < 0)
     throw_errno(errno, "failed to listen on bluetooth socket");
 
+  int flags = fcntl(m_listen_fd, F_GETFL, 0);
+  if (fcntl(m_listen_fd, F_SETFL, flags | O_NONBLOCK) < 0)
+    throw_errno(errno, "failed to set bluetooth socket non-blocking");
+
+  // pending data is announced as soon as it's queued. The periodic poll is
+  // only a fallback for clients that miss a notification and is off unless
+  // configured.
+  m_poll_interval = JsonRpc::getInt(conf, "poll-interval", false, 0);
+
+  // largest ATT MTU offered during the MTU exchange, the value actually used
+  // for a connection is the smaller of this and what the client asks for
+  m_max_mtu = JsonRpc::getInt(conf, "att-mtu", false, BT_ATT_MAX_LE_MTU);
+  if (m_max_mtu < BT_ATT_DEFAULT_LE_MTU || m_max_mtu > BT_ATT_MAX_LE_MTU)
+  {
+    XLOG_WARN("invalid att-mtu:%d, using %d", m_max_mtu, BT_ATT_MAX_LE_MTU);
+    m_max_mtu = BT_ATT_MAX_LE_MTU;
+  }
+
+  m_hci_device_id = JsonRpc::getInt(conf, "hci-device-id", false, 0);
+
   startBeacon(
       JsonRpc::getString(conf, "ble-name", false, "XPI-SETUP"),
-      JsonRpc::getInt(conf, "hci-device-id", false, 0));
+      m_hci_device_id);
 }
 
-std::shared_ptr<RpcConnectedClient>
-GattServer::accept(DeviceInfoProvider const& deviceInfoProvider)
+void
+GattServer::run(DeviceInfoProvider const& deviceInfoProvider,
+  RpcClientHandler const& onConnect, RpcClientHandler const& onDisconnect)
 {
+  m_device_info_provider = deviceInfoProvider;
+  m_on_connect = onConnect;
+  m_on_disconnect = onDisconnect;
+
   mainloop_init();
 
-  sockaddr_l2 peer_addr;
-  memset(&peer_addr, 0, sizeof(peer_addr));
+  if (mainloop_add_fd(m_listen_fd, EPOLLIN, &GattServer_onAcceptReady, this, nullptr) < 0)
+    throw_errno(errno, "failed to add bluetooth socket to mainloop");
+
+  // the att code only runs on the mainloop, so the reactor the services use
+  // is nested inside it rather than the other way around. Its sources are
+  // dispatched on this thread whenever its epoll fd is readable
+  if (mainloop_add_fd(Reactor::main().fd(), EPOLLIN, &GattServer_onReactorReady, nullptr,
+    nullptr) < 0)
+    throw_errno(errno, "failed to add reactor to mainloop");
 
   XLOG_INFO("waiting for incoming BLE connections");
+  mainloop_run();
+}
 
-  socklen_t n = sizeof(peer_addr);
-  int soc = ::accept(m_listen_fd, reinterpret_cast<sockaddr *>(&peer_addr), &n);
-  if (soc < 0)
-    throw_errno(errno, "failed to accept incoming connection on bluetooth socket");
+void
+GattServer::onAcceptReady()
+{
+  while (true)
+  {
+    sockaddr_l2 peer_addr;
+    memset(&peer_addr, 0, sizeof(peer_addr));
+
+    socklen_t n = sizeof(peer_addr);
+    int soc = ::accept(m_listen_fd, reinterpret_cast<sockaddr *>(&peer_addr), &n);
+    if (soc < 0)
+    {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+        XLOG_ERROR("failed to accept incoming connection on bluetooth socket. %s",
+          strerror(errno));
+      return;
+    }
 
-  char remote_address[64] = {0};
-  ba2str(&peer_addr.l2_bdaddr, remote_address);
-  XLOG_INFO("accepted remote connection from:%s", remote_address);
+    char remote_address[64] = {0};
+    ba2str(&peer_addr.l2_bdaddr, remote_address);
+    XLOG_INFO("accepted remote connection from:%s", remote_address);
 
-  auto clnt = std::shared_ptr<GattClient>(new GattClient(soc));
-  clnt->init(deviceInfoProvider);
-  return clnt;
+    if (static_cast<int>(m_clients.size()) >= m_max_clients)
+    {
+      XLOG_WARN("already serving %zu clients, rejecting %s", m_clients.size(), remote_address);
+      close(soc);
+      continue;
+    }
+
+    auto clnt = std::shared_ptr<GattClient>(new GattClient(soc, m_poll_interval, m_max_mtu));
+    clnt->init(m_device_info_provider);
+
+    GattClient* p = clnt.get();
+    clnt->setDisconnectHandler([this, p] { this->onClientDisconnected(p); });
+    m_clients.push_back(clnt);
+
+    if (m_on_connect)
+      m_on_connect(clnt);
+
+    // the controller stops advertising once a central connects, turn it
+    // back on so others can find us while there's room
+    if (static_cast<int>(m_clients.size()) < m_max_clients)
+      resumeBeacon(m_hci_device_id);
+  }
+}
+
+void
+GattServer::onClientDisconnected(GattClient* client)
+{
+  bool was_full = static_cast<int>(m_clients.size()) >= m_max_clients;
+
+  for (auto itr = m_clients.begin(); itr != m_clients.end(); ++itr)
+  {
+    if (itr->get() == client)
+    {
+      if (m_on_disconnect)
+        m_on_disconnect(*itr);
+
+      // this is called from inside the client's att disconnect callback,
+      // so the client is released later from the mainloop
+      m_closed_clients.push_back(*itr);
+      m_clients.erase(itr);
+      break;
+    }
+  }
+
+  if (m_reap_timeout_id == -1)
+    m_reap_timeout_id = mainloop_add_timeout(1, &GattServer_onReapTimeout, this, nullptr);
+
+  if (was_full)
+    resumeBeacon(m_hci_device_id);
+}
+
+void
+GattServer::onReapTimeout()
+{
+  // a worker that loaded the rpc server's client snapshot before the client
+  // was removed can still be sending to it. Keep each client until this is
+  // the last reference so it's always destroyed on the mainloop thread.
+  auto itr = std::remove_if(m_closed_clients.begin(), m_closed_clients.end(),
+    [](std::shared_ptr<GattClient> const& client) { return client.use_count() == 1; });
+  m_closed_clients.erase(itr, m_closed_clients.end());
+
+  // mainloop timeouts only fire once, so one that's left in place has to be
+  // re-armed or every client closed from now on is kept forever
+  if (m_closed_clients.empty())
+  {
+    mainloop_remove_timeout(m_reap_timeout_id);
+    m_reap_timeout_id = -1;
+  }
+  else
+  {
+    XLOG_DEBUG("%zu closed clients still in use, checking again in %dms",
+      m_closed_clients.size(), kReapRetryInterval);
+    mainloop_modify_timeout(m_reap_timeout_id, kReapRetryInterval);
+  }
 }
 
 void
@@ -276,7 +439,7 @@ GattClient::init(DeviceInfoProvider const& deviceInfoProvider)
     XLOG_ERROR("failed to create gatt database");
   }
 
-  m_server = bt_gatt_server_new(m_db, m_att, m_mtu, 0);
+  m_server = bt_gatt_server_new(m_db, m_att, m_max_mtu, 0);
   if (!m_server)
   {
     XLOG_ERROR("failed to create gatt server");
@@ -288,7 +451,16 @@ GattClient::init(DeviceInfoProvider const& deviceInfoProvider)
     bt_gatt_server_set_debug(m_server, GATT_debugCallback, this, nullptr);
   }
 
-  m_timeout_id = mainloop_add_timeout(1000, &GattClient_onTimeout, this, nullptr);
+  m_wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (m_wakeup_fd == -1)
+    throw_errno(errno, "failed to create eventfd for outgoing data");
+
+  if (mainloop_add_fd(m_wakeup_fd, EPOLLIN, &GattClient_onWakeup, this, nullptr) < 0)
+    XLOG_ERROR("failed to add wakeup eventfd to mainloop");
+
+  if (m_poll_interval > 0)
+    m_timeout_id = mainloop_add_timeout(m_poll_interval, &GattClient_onTimeout, this, nullptr);
+
   buildGattDatabase(deviceInfoProvider);
 }
 
@@ -334,10 +506,10 @@ GattClient::buildJsonRpcService()
   m_blepoll = gatt_db_service_add_characteristic(
     service,
     &uuid,
-    BT_ATT_PERM_READ,
-    BT_GATT_CHRC_PROP_READ | BT_GATT_CHRC_PROP_NOTIFY,
+    BT_ATT_PERM_READ | BT_ATT_PERM_WRITE,
+    BT_GATT_CHRC_PROP_READ | BT_GATT_CHRC_PROP_WRITE | BT_GATT_CHRC_PROP_NOTIFY,
     &GattClient_onEPollRead,
-    nullptr,
+    &GattClient_onEPollWrite,
     this);
   m_notify_handle = gatt_db_attribute_get_handle(m_blepoll);
 
@@ -406,36 +578,42 @@ GattClient::onDataChannelOut(
   XLOG_INFO("onDataChannelOut(id=%d, offset=%u, opcode=%d)",
     id, offset, opcode);
 
-  static int32_t const kBufferSize = 256;
-  static uint8_t buff[kBufferSize];
-
-  int n = 0;
-
+  // A read at offset zero starts a new segment sized so that it fits in a
+  // single ATT read response (MTU - 1). Read Blob requests for the same
+  // segment are served from the cursor until the next read at offset zero.
   if (offset == 0)
   {
-    memset(buff, 0, sizeof(buff));
-    n = m_outgoing_queue.get_line((char *)buff, kBufferSize);
+    updateMtu();
+    int n = m_outgoing_queue.get_line(reinterpret_cast<char *>(&m_read_segment[0]),
+      m_mtu - 1);
+    m_read_segment_length = static_cast<size_t>(n);
   }
-  else
-  {
-    int bytesToWrite = 0;
-    while ((bytesToWrite + offset) < kBufferSize && (buff[offset + bytesToWrite] != '\0'))
-      bytesToWrite++;
 
-    n = bytesToWrite;
-    XLOG_INFO("bytesToWrite:%d offset:%d n:%d", bytesToWrite, offset, n);
+  if (offset > m_read_segment_length)
+  {
+    gatt_db_attribute_read_result(attr, id, BT_ATT_ERROR_INVALID_OFFSET, nullptr, 0);
+    return;
   }
 
   uint8_t const* value = nullptr;
+  size_t n = m_read_segment_length - offset;
   if (n > 0)
-    value = buff + offset;
-  else
-    buff[0] = '\0';
+    value = &m_read_segment[offset];
 
-  // printf("write:%.*s\n", n, (char *) value);
   gatt_db_attribute_read_result(attr, id, 0, value, n);
 }
 
+void
+GattClient::updateMtu()
+{
+  uint16_t mtu = bt_att_get_mtu(m_att);
+  if (mtu != m_mtu)
+  {
+    XLOG_INFO("att mtu changed from %u to %u", m_mtu, mtu);
+    m_mtu = mtu;
+  }
+}
+
 void
 GattClient::onEPollRead(
   gatt_db_attribute*    attr,
@@ -453,6 +631,43 @@ GattClient::onEPollRead(
     sizeof(value));
 }
 
+void
+GattClient::onEPollWrite(
+  gatt_db_attribute*    attr,
+  uint32_t              id,
+  uint16_t              offset,
+  uint8_t const*        data,
+  size_t                len,
+  uint8_t               UNUSED_PARAM(opcode),
+  bt_att*               UNUSED_PARAM(att))
+{
+  uint8_t ecode = 0;
+  if (!data || len != 1)
+    ecode = BT_ATT_ERROR_INVALID_ATTRIBUTE_VALUE_LEN;
+
+  if (!ecode && offset)
+    ecode = BT_ATT_ERROR_INVALID_OFFSET;
+
+  if (!ecode)
+  {
+    if (data[0] == kDeliveryModePoll)
+      m_push_mode = false;
+    else if (data[0] == kDeliveryModePush)
+      m_push_mode = true;
+    else
+      ecode = BT_ATT_ERROR_VALUE_NOT_ALLOWED;
+  }
+
+  if (!ecode)
+    XLOG_INFO("response delivery mode set to %s", m_push_mode ? "push" : "poll");
+
+  gatt_db_attribute_write_result(attr, id, ecode);
+
+  // anything queued before the switch goes out right away
+  if (!ecode)
+    notifyPendingData();
+}
+
 void
 GattClient::onGapExtendedPropertiesRead(
   struct gatt_db_attribute*     attr,
@@ -672,6 +887,29 @@ GattClient::buildDeviceInfoService(DeviceInfoProvider const& deviceInfoProvider)
 void
 GattClient::onTimeout()
 {
+  notifyPendingData();
+  mainloop_modify_timeout(m_timeout_id, m_poll_interval);
+}
+
+void
+GattClient::onWakeup(uint32_t UNUSED_PARAM(events))
+{
+  uint64_t count = 0;
+  if (read(m_wakeup_fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+    XLOG_WARN("failed to read wakeup eventfd. %s", strerror(errno));
+
+  notifyPendingData();
+}
+
+void
+GattClient::notifyPendingData()
+{
+  if (m_push_mode)
+  {
+    pushPendingData();
+    return;
+  }
+
   uint32_t bytes_available = m_outgoing_queue.size();
 
   if (bytes_available > 0)
@@ -694,51 +932,105 @@ GattClient::onTimeout()
         ret, bytes_available);
     }
   }
-
-  mainloop_modify_timeout(m_timeout_id, 1000);
 }
 
 void
-GattClient::run()
+GattClient::pushPendingData()
 {
-  m_mainloop_thread = std::this_thread::get_id();
+  updateMtu();
 
-  sigset_t mask;
-  sigemptyset(&mask);
-  sigaddset(&mask, SIGINT);
-  sigaddset(&mask, SIGTERM);
+  // each notification carries as much of the current record as fits, the
+  // client reassembles until it sees the record delimiter. A segment is only
+  // taken off the queue once the att has accepted it, one it refuses is
+  // tried again on the next wakeup or timeout
+  int const segment_size = m_mtu - kNotificationHeaderSize;
+  uint16_t const handle = m_notify_handle;
 
-  mainloop_run();
+  m_notify_pdu[0] = static_cast<uint8_t>(handle & 0xff);
+  m_notify_pdu[1] = static_cast<uint8_t>(handle >> 8);
+  char* buff = reinterpret_cast<char *>(&m_notify_pdu[2]);
+
+  while (m_notifications_in_flight < kMaxNotificationsInFlight)
+  {
+    int n = m_outgoing_queue.peek_line(buff, segment_size);
+    if (n <= 0)
+      break;
+
+    unsigned int id = bt_att_send(m_att, BT_ATT_OP_HANDLE_VAL_NOT, &m_notify_pdu[0],
+      static_cast<uint16_t>(n + 2), nullptr, this, &GattClient_onNotificationSent);
+    if (id == 0)
+    {
+      XLOG_WARN("failed to push %d bytes of response data", n);
+      break;
+    }
+
+    m_outgoing_queue.consume(n);
+    m_notifications_in_flight++;
+  }
 }
 
-GattClient::GattClient(int fd)
+void
+GattClient::onNotificationSent()
+{
+  m_notifications_in_flight--;
+
+  // the att drops whatever it hasn't written when it's released, the server
+  // is gone by then
+  if (m_server && m_push_mode)
+    pushPendingData();
+}
+
+GattClient::GattClient(int fd, int pollInterval, uint16_t maxMtu)
   : RpcConnectedClient()
   , m_fd(fd)
   , m_att(nullptr)
   , m_db(nullptr)
   , m_server(nullptr)
-  , m_mtu(16)
+  , m_mtu(BT_ATT_DEFAULT_LE_MTU)
+  , m_max_mtu(maxMtu)
   , m_outgoing_queue(kRecordDelimiter)
+  , m_read_segment(maxMtu)
+  , m_read_segment_length(0)
+  , m_notify_pdu(maxMtu)
+  , m_notifications_in_flight(0)
+  , m_push_mode(false)
   , m_incoming_buff()
   , m_data_channel(nullptr)
   , m_blepoll(nullptr)
   , m_service_change_enabled(false)
   , m_timeout_id(-1)
-  , m_mainloop_thread()
+  , m_poll_interval(pollInterval)
+  , m_wakeup_fd(-1)
   , m_data_handler(nullptr)
+  , m_disconnect_handler(nullptr)
 {
 }
 
 GattClient::~GattClient()
 {
-  if (m_fd != -1)
-    close(m_fd);
+  if (m_timeout_id != -1)
+    mainloop_remove_timeout(m_timeout_id);
+
+  if (m_wakeup_fd != -1)
+  {
+    mainloop_remove_fd(m_wakeup_fd);
+    close(m_wakeup_fd);
+  }
 
   if (m_server)
+  {
     bt_gatt_server_unref(m_server);
+    m_server = nullptr;
+  }
 
   if (m_db)
     gatt_db_unref(m_db);
+
+  // the att closes the socket when it's released
+  if (m_att)
+    bt_att_unref(m_att);
+  else if (m_fd != -1)
+    close(m_fd);
 }
 
 void
@@ -756,7 +1048,44 @@ GattClient::enqueueForSend(char const* buff, int n)
     return;
   }
 
-  m_outgoing_queue.put_line(buff, n);
+  std::vector<char> record;
+  record.reserve(n + 1);
+  record.insert(record.end(), buff, buff + n);
+  enqueueForSend(std::move(record));
+}
+
+void
+GattClient::enqueueForSend(std::vector<char>&& record)
+{
+  if (record.empty())
+  {
+    XLOG_WARN("trying to enqueue empty record");
+    return;
+  }
+
+  m_outgoing_queue.put_line(std::move(record));
+
+  // called from the rpc dispatch thread, wake the mainloop so the
+  // notification goes out from the thread that owns the att
+  uint64_t one = 1;
+  if (m_wakeup_fd != -1 && write(m_wakeup_fd, &one, sizeof(one)) < 0)
+    XLOG_WARN("failed to signal outgoing data. %s", strerror(errno));
+}
+
+void
+GattClient::enqueuePartial(std::vector<char>&& part, bool last)
+{
+  m_outgoing_queue.put_partial(std::move(part), last);
+
+  uint64_t one = 1;
+  if (m_wakeup_fd != -1 && write(m_wakeup_fd, &one, sizeof(one)) < 0)
+    XLOG_WARN("failed to signal outgoing data. %s", strerror(errno));
+}
+
+bool
+GattClient::waitForSendSpace(size_t limit, std::chrono::milliseconds timeout)
+{
+  return m_outgoing_queue.wait_for_space(limit, timeout);
 }
 
 void
@@ -766,5 +1095,6 @@ GattClient::onClientDisconnected(int err)
   // GattClient so we can print out mac addres of client that
   // just disconnected
   XLOG_INFO("disconnect:%d", err);
-  mainloop_quit();
+  if (m_disconnect_handler)
+    m_disconnect_handler();
 }
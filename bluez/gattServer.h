@@ -22,7 +22,7 @@
 #include <vector>
 #include <sstream>
 
-#include "../memory_stream.h"
+#include "../record_queue.h"
 #include "../rpcserver.h"
 
 #include <bluetooth/bluetooth.h>
@@ -44,15 +44,19 @@ struct gatt_db_attribute;
 class GattClient : public RpcConnectedClient
 {
 public:
-  GattClient(int fd);
+  GattClient(int fd, int pollInterval, uint16_t maxMtu);
   virtual ~GattClient();
 
   virtual void init(DeviceInfoProvider const& provider) override;
-  virtual void enqueueForSend(char const* buff, int n) override; 
-  virtual void run() override;
+  virtual void enqueueForSend(char const* buff, int n) override;
+  virtual void enqueueForSend(std::vector<char>&& record) override;
+  virtual bool waitForSendSpace(size_t limit, std::chrono::milliseconds timeout) override;
   virtual void setDataHandler(RpcDataHandler const& handler) override
     { m_data_handler = handler; }
 
+  void setDisconnectHandler(std::function<void ()> const& handler)
+    { m_disconnect_handler = handler; }
+
   void onDataChannelOut(gatt_db_attribute* attr, uint32_t id, uint16_t offset,
     uint8_t opcode, bt_att* att);
 
@@ -61,9 +65,16 @@ public:
 
   void onTimeout();
 
+  void onWakeup(uint32_t events);
+
+  void onNotificationSent();
+
   void onEPollRead(gatt_db_attribute* attr, uint32_t id, uint16_t offset,
     uint8_t opcode, bt_att* att);
 
+  void onEPollWrite(gatt_db_attribute* attr, uint32_t id, uint16_t offset,
+    uint8_t const* data, size_t len, uint8_t opcode, bt_att* att);
+
   void onClientDisconnected(int err);
 
   void onGapRead(gatt_db_attribute* attr, uint32_t id, uint16_t offset,
@@ -84,6 +95,9 @@ public:
   void onGapExtendedPropertiesRead(gatt_db_attribute *attrib, uint32_t id,
     uint16_t offset, uint8_t opcode, bt_att* att);
 
+protected:
+  virtual void enqueuePartial(std::vector<char>&& part, bool last) override;
+
 private:
   void buildGattDatabase(DeviceInfoProvider const& deviceInfoProvider);
 
@@ -93,6 +107,9 @@ private:
   void addDeviceInfoCharacteristic(gatt_db_attribute* service, uint16_t id,
     std::string const& value);
   void buildJsonRpcService();
+  void notifyPendingData();
+  void pushPendingData();
+  void updateMtu();
 
 private:
   int                 m_fd;
@@ -100,15 +117,23 @@ private:
   gatt_db*            m_db;
   bt_gatt_server*     m_server;
   uint16_t            m_mtu;
-  memory_stream       m_outgoing_queue;
+  uint16_t            m_max_mtu;
+  record_queue        m_outgoing_queue;
+  std::vector<uint8_t> m_read_segment;
+  size_t              m_read_segment_length;
+  std::vector<uint8_t> m_notify_pdu;
+  int                 m_notifications_in_flight;
+  bool                m_push_mode;
   std::vector<char>   m_incoming_buff;
   gatt_db_attribute*  m_data_channel;
   gatt_db_attribute*  m_blepoll;
   uint16_t            m_notify_handle;
   bool                m_service_change_enabled;
   int                 m_timeout_id;
-  std::thread::id     m_mainloop_thread;
+  int                 m_poll_interval;
+  int                 m_wakeup_fd;
   RpcDataHandler      m_data_handler;
+  std::function<void ()> m_disconnect_handler;
 };
 
 class GattServer : public RpcListener
@@ -118,12 +143,28 @@ public:
   virtual ~GattServer();
 
   virtual void init(cJSON const* conf) override;
-  virtual std::shared_ptr<RpcConnectedClient>
-    accept(DeviceInfoProvider const& deviceInfoProvider) override;
+  virtual void run(DeviceInfoProvider const& deviceInfoProvider,
+    RpcClientHandler const& onConnect, RpcClientHandler const& onDisconnect) override;
+
+  void onAcceptReady();
+  void onReapTimeout();
+
+private:
+  void onClientDisconnected(GattClient* client);
 
 private:
   int             m_listen_fd;
   bdaddr_t        m_local_interface;
+  int             m_poll_interval;
+  int             m_max_mtu;
+  int             m_max_clients;
+  int             m_hci_device_id;
+  int             m_reap_timeout_id;
+  DeviceInfoProvider                        m_device_info_provider;
+  RpcClientHandler                          m_on_connect;
+  RpcClientHandler                          m_on_disconnect;
+  std::vector< std::shared_ptr<GattClient> > m_clients;
+  std::vector< std::shared_ptr<GattClient> > m_closed_clients;
 };
 
 #endif
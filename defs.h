@@ -21,4 +21,10 @@
 
 #define kJsonRpcVersion "2.0"
 
+// JSON-RPC 2.0 error code for a request that isn't a valid request object
+#define kJsonRpcInvalidRequest -32600
+
+// JSON-RPC 2.0 error code for a request whose params don't fit the method
+#define kJsonRpcInvalidParams -32602
+
 #endif
@@ -0,0 +1,115 @@
+//
+// Copyright [2018] [Comcast, Corp]
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#ifndef __DISPATCH_TABLE_H__
+#define __DISPATCH_TABLE_H__
+
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+// Immutable string keyed table with open addressing. It's built once from
+// the complete set of entries and then only read, so lookups need no
+// locking. find() hashes the key in place and never allocates.
+template<class T>
+class dispatch_table
+{
+public:
+  dispatch_table()
+    : m_mask(0) { }
+
+  // replaces the contents of the table. Later duplicates of a name are
+  // dropped
+  void build(std::vector< std::pair<std::string, T> >&& entries)
+  {
+    m_entries.clear();
+    m_entries.reserve(entries.size());
+
+    // keep the load factor at or under one half so probe runs stay short
+    size_t capacity = 8;
+    while (capacity < entries.size() * 2)
+      capacity <<= 1;
+    m_slots.assign(capacity, static_cast<int32_t>(kEmptySlot));
+    m_mask = capacity - 1;
+
+    for (auto& entry : entries)
+    {
+      size_t n = entry.first.size();
+      uint32_t hash = fnv1a(entry.first.c_str(), n);
+      if (lookup(entry.first.c_str(), n, hash) != nullptr)
+        continue;
+
+      size_t slot = hash & m_mask;
+      while (m_slots[slot] != kEmptySlot)
+        slot = (slot + 1) & m_mask;
+
+      m_slots[slot] = static_cast<int32_t>(m_entries.size());
+      m_entries.push_back(entry_type { std::move(entry.first), hash, std::move(entry.second) });
+    }
+  }
+
+  T const* find(char const* name) const
+  {
+    if (!name || m_entries.empty())
+      return nullptr;
+    size_t n = strlen(name);
+    return lookup(name, n, fnv1a(name, n));
+  }
+
+  size_t size() const
+    { return m_entries.size(); }
+
+private:
+  struct entry_type
+  {
+    std::string Name;
+    uint32_t    Hash;
+    T           Value;
+  };
+
+  enum { kEmptySlot = -1 };
+
+  static uint32_t fnv1a(char const* s, size_t n)
+  {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < n; ++i)
+    {
+      h ^= static_cast<unsigned char>(s[i]);
+      h *= 16777619u;
+    }
+    return h;
+  }
+
+  T const* lookup(char const* name, size_t n, uint32_t hash) const
+  {
+    for (size_t slot = hash & m_mask; m_slots[slot] != kEmptySlot; slot = (slot + 1) & m_mask)
+    {
+      entry_type const& entry = m_entries[m_slots[slot]];
+      if (entry.Hash == hash && entry.Name.size() == n && memcmp(entry.Name.data(), name, n) == 0)
+        return &entry.Value;
+    }
+    return nullptr;
+  }
+
+private:
+  std::vector<entry_type> m_entries;
+  std::vector<int32_t>    m_slots;
+  size_t                  m_mask;
+};
+
+#endif
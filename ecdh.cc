@@ -125,7 +125,7 @@ int main(int argc, char* argv[])
   {
     char* s = cJSON_Print(wifi_settings);
     printf("%s\n", s);
-    free(s);
+    cJSON_free(s);
     cJSON_Delete(wifi_settings);
   }
 
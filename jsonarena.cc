@@ -0,0 +1,236 @@
+//
+// Copyright [2018] [Comcast, Corp]
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#include "jsonarena.h"
+
+#include <cJSON.h>
+
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+#include <stdlib.h>
+
+struct JsonArena::Block
+{
+  Block*  Next;
+  size_t  Size;
+};
+
+namespace
+{
+  // every allocation carries its owner so cJSON_free can tell arena memory
+  // from heap memory. The header keeps the returned pointer max aligned
+  union AllocationHeader
+  {
+    JsonArena*    Owner;
+    std::max_align_t   Align;
+  };
+
+  size_t const kHeaderSize = sizeof(AllocationHeader);
+  size_t const kAlignment = alignof(std::max_align_t);
+
+  // most requests and responses fit in one block. Anything bigger than a
+  // quarter of a block gets a block of its own so large strings don't waste
+  // the tail of the current one
+  size_t const kBlockSize = 8 * 1024;
+  size_t const kLargeAllocation = kBlockSize / 4;
+
+  // released blocks are kept for the next request rather than going back to
+  // malloc, up to a limit
+  size_t const kMaxPooledBlocks = 64;
+
+  struct BlockPool
+  {
+    ~BlockPool()
+    {
+      for (void* p : Blocks)
+        free(p);
+    }
+
+    std::mutex          Mutex;
+    std::vector<void*>  Blocks;
+  };
+
+  BlockPool blockPool;
+
+  thread_local JsonArena* currentArena = nullptr;
+
+  inline size_t alignUp(size_t n)
+  {
+    return (n + kAlignment - 1) & ~(kAlignment - 1);
+  }
+
+  void* jsonMalloc(size_t n)
+  {
+    if (currentArena)
+      return currentArena->allocate(n);
+
+    AllocationHeader* header = static_cast<AllocationHeader *>(malloc(kHeaderSize + n));
+    if (!header)
+      return nullptr;
+    header->Owner = nullptr;
+    return header + 1;
+  }
+
+  void jsonFree(void* p)
+  {
+    if (!p)
+      return;
+
+    // arena memory goes away with the arena
+    AllocationHeader* header = static_cast<AllocationHeader *>(p) - 1;
+    if (!header->Owner)
+      free(header);
+  }
+
+  void* takePooledBlock()
+  {
+    std::lock_guard<std::mutex> guard(blockPool.Mutex);
+    if (blockPool.Blocks.empty())
+      return nullptr;
+    void* p = blockPool.Blocks.back();
+    blockPool.Blocks.pop_back();
+    return p;
+  }
+
+  void releaseBlock(void* p, size_t size)
+  {
+    if (size == kBlockSize)
+    {
+      std::lock_guard<std::mutex> guard(blockPool.Mutex);
+      if (blockPool.Blocks.size() < kMaxPooledBlocks)
+      {
+        blockPool.Blocks.push_back(p);
+        return;
+      }
+    }
+    free(p);
+  }
+}
+
+JsonArena::JsonArena()
+  : m_blocks(nullptr)
+  , m_next(nullptr)
+  , m_end(nullptr)
+  , m_bytes_allocated(0)
+{
+}
+
+JsonArena::~JsonArena()
+{
+  reset();
+}
+
+void*
+JsonArena::allocate(size_t n)
+{
+  size_t const size = kHeaderSize + alignUp(n);
+  if (size > static_cast<size_t>(m_end - m_next))
+  {
+    if (size > kLargeAllocation)
+    {
+      // oversized allocations get their own block behind the current one
+      // so the rest of the current block can still be used
+      size_t blockSize = alignUp(sizeof(Block)) + size;
+      Block* block = static_cast<Block *>(malloc(blockSize));
+      if (!block)
+        return nullptr;
+      block->Size = blockSize;
+      if (m_blocks)
+      {
+        block->Next = m_blocks->Next;
+        m_blocks->Next = block;
+      }
+      else
+      {
+        block->Next = nullptr;
+        m_blocks = block;
+      }
+
+      AllocationHeader* header = reinterpret_cast<AllocationHeader *>(
+        reinterpret_cast<char *>(block) + alignUp(sizeof(Block)));
+      header->Owner = this;
+      m_bytes_allocated += size;
+      return header + 1;
+    }
+
+    addBlock();
+    if (!m_next)
+      return nullptr;
+  }
+
+  AllocationHeader* header = reinterpret_cast<AllocationHeader *>(m_next);
+  header->Owner = this;
+  m_next += size;
+  m_bytes_allocated += size;
+  return header + 1;
+}
+
+void
+JsonArena::addBlock()
+{
+  void* p = takePooledBlock();
+  if (!p)
+    p = malloc(kBlockSize);
+
+  if (!p)
+  {
+    m_next = m_end = nullptr;
+    return;
+  }
+
+  Block* block = static_cast<Block *>(p);
+  block->Size = kBlockSize;
+  block->Next = m_blocks;
+  m_blocks = block;
+
+  m_next = static_cast<char *>(p) + alignUp(sizeof(Block));
+  m_end = static_cast<char *>(p) + kBlockSize;
+}
+
+void
+JsonArena::reset()
+{
+  while (m_blocks)
+  {
+    Block* next = m_blocks->Next;
+    releaseBlock(m_blocks, m_blocks->Size);
+    m_blocks = next;
+  }
+
+  m_next = m_end = nullptr;
+  m_bytes_allocated = 0;
+}
+
+void
+JsonArena::installHooks()
+{
+  cJSON_Hooks hooks;
+  hooks.malloc_fn = &jsonMalloc;
+  hooks.free_fn = &jsonFree;
+  cJSON_InitHooks(&hooks);
+}
+
+JsonArena::Scope::Scope(JsonArena* arena)
+  : m_prev(currentArena)
+{
+  currentArena = arena;
+}
+
+JsonArena::Scope::~Scope()
+{
+  currentArena = m_prev;
+}
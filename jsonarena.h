@@ -0,0 +1,84 @@
+//
+// Copyright [2018] [Comcast, Corp]
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#ifndef __JSON_ARENA_H__
+#define __JSON_ARENA_H__
+
+#include <stddef.h>
+
+// Bump allocator for the cJSON trees built while handling one request. Once
+// the hooks are installed every cJSON allocation made on a thread with an
+// active arena comes out of that arena, and cJSON_free of arena memory does
+// nothing. The whole arena is given back in one go when it's destroyed, so
+// the request, result and response trees never fragment the heap.
+//
+// Trees allocated from an arena must be deleted, or simply dropped, before
+// the arena goes away, and must never be kept past the request. Code that
+// needs a long lived tree while an arena is active opens a
+// JsonArena::Scope(nullptr) around it.
+class JsonArena
+{
+public:
+  JsonArena();
+  ~JsonArena();
+
+  void* allocate(size_t n);
+
+  // gives back every block, anything allocated from the arena is invalid
+  // after this
+  void reset();
+
+  // bytes handed out since the last reset, including per allocation
+  // headers
+  size_t bytesAllocated() const
+    { return m_bytes_allocated; }
+
+  // routes cJSON through the arena aware allocator. It has to run before
+  // the first cJSON allocation since memory from the plain heap can't be
+  // told apart from arena memory afterwards
+  static void installHooks();
+
+  // makes an arena current on the calling thread for the life of the scope,
+  // nullptr sends cJSON back to the heap
+  class Scope
+  {
+  public:
+    explicit Scope(JsonArena* arena);
+    ~Scope();
+
+  private:
+    Scope(Scope const&) = delete;
+    Scope& operator=(Scope const&) = delete;
+
+  private:
+    JsonArena* m_prev;
+  };
+
+private:
+  struct Block;
+
+  JsonArena(JsonArena const&) = delete;
+  JsonArena& operator=(JsonArena const&) = delete;
+
+  void addBlock();
+
+private:
+  Block*  m_blocks;
+  char*   m_next;
+  char*   m_end;
+  size_t  m_bytes_allocated;
+};
+
+#endif
@@ -0,0 +1,229 @@
+//
+// Copyright [2018] [Comcast, Corp]
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#include "jsonpath.h"
+
+#include <cJSON.h>
+
+#include <stdexcept>
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+namespace
+{
+  void throwBadPath(char const* path, size_t pos, char const* what)
+  {
+    std::string msg("invalid json path '");
+    msg += path;
+    msg += "' at ";
+    msg += std::to_string(pos);
+    msg += ", ";
+    msg += what;
+    throw std::runtime_error(msg);
+  }
+
+  // same rule cJSON_GetObjectItem uses for member names. Folding the first
+  // character by hand rejects most siblings without the library call
+  inline bool nameEquals(char const* name, char const* s, size_t n)
+  {
+    if (!name)
+      return false;
+    if (n > 0 && (name[0] | 0x20) != (s[0] | 0x20))
+      return false;
+    return strncasecmp(name, s, n) == 0 && name[n] == '\0';
+  }
+
+  inline bool valueEquals(char const* value, char const* s, size_t n)
+  {
+    return value && strncmp(value, s, n) == 0 && value[n] == '\0';
+  }
+}
+
+JsonPath::JsonPath(char const* path)
+  : m_path(path ? path : "")
+{
+  compile();
+}
+
+JsonPath::JsonPath(std::string const& path)
+  : m_path(path)
+{
+  compile();
+}
+
+void
+JsonPath::compile()
+{
+  if (m_path.empty())
+    throw std::runtime_error("empty json path");
+
+  size_t pos = 0;
+  Step step = Step();
+  while (nextStep(m_path.c_str(), pos, step))
+    m_steps.push_back(step);
+}
+
+cJSON const*
+JsonPath::find(cJSON const* json) const
+{
+  cJSON const* item = json;
+  char const* path = m_path.c_str();
+  for (Step const& step : m_steps)
+  {
+    item = applyStep(item, path, step);
+    if (!item)
+      break;
+  }
+  return item;
+}
+
+cJSON const*
+JsonPath::find(cJSON const* json, char const* path)
+{
+  cJSON const* item = json;
+
+  size_t pos = 0;
+  Step step = Step();
+  while (item && nextStep(path, pos, step))
+    item = applyStep(item, path, step);
+
+  return item;
+}
+
+bool
+JsonPath::nextStep(char const* path, size_t& pos, Step& step)
+{
+  // a plain name is one member, taken literally
+  if (path[0] != '/')
+  {
+    if (pos > 0)
+      return false;
+    step.Type = StepType::Member;
+    step.Name = 0;
+    step.NameLength = strlen(path);
+    pos = step.NameLength;
+    return true;
+  }
+
+  // empty segments are skipped, "/params//key" is "/params/key"
+  while (path[pos] == '/' && path[pos + 1] == '/')
+    pos++;
+
+  if (path[pos] == '\0' || (path[pos] == '/' && path[pos + 1] == '\0'))
+    return false;
+
+  if (path[pos] == '/' && path[pos + 1] != '[')
+  {
+    size_t begin = ++pos;
+    while (path[pos] != '\0' && path[pos] != '/' && path[pos] != '[')
+      pos++;
+
+    step.Type = StepType::Member;
+    step.Name = begin;
+    step.NameLength = pos - begin;
+    return true;
+  }
+
+  if (path[pos] == '/')
+    pos++;
+
+  if (path[pos] != '[')
+    throwBadPath(path, pos, "expected '/' or '['");
+  pos++;
+
+  if (path[pos] == '@')
+  {
+    // [@attr='value'] or [@attr="value"]
+    size_t begin = ++pos;
+    while (path[pos] != '\0' && path[pos] != '=' && path[pos] != ']')
+      pos++;
+    if (path[pos] != '=' || pos == begin)
+      throwBadPath(path, pos, "expected [@name='value']");
+
+    step.Type = StepType::Match;
+    step.Name = begin;
+    step.NameLength = pos - begin;
+
+    char quote = path[++pos];
+    if (quote != '\'' && quote != '"')
+      throwBadPath(path, pos, "expected a quoted value");
+
+    begin = ++pos;
+    while (path[pos] != '\0' && path[pos] != quote)
+      pos++;
+    if (path[pos] != quote)
+      throwBadPath(path, pos, "unterminated value");
+
+    step.Value = begin;
+    step.ValueLength = pos - begin;
+    pos++;
+  }
+  else
+  {
+    // [n]
+    char* end = nullptr;
+    long index = strtol(path + pos, &end, 10);
+    if (end == path + pos || index < 0)
+      throwBadPath(path, pos, "expected an array index");
+
+    step.Type = StepType::Index;
+    step.Index = static_cast<int>(index);
+    pos = end - path;
+  }
+
+  if (path[pos] != ']')
+    throwBadPath(path, pos, "expected ']'");
+  pos++;
+
+  return true;
+}
+
+cJSON const*
+JsonPath::applyStep(cJSON const* item, char const* path, Step const& step)
+{
+  cJSON const* child = item->child;
+  switch (step.Type)
+  {
+    case StepType::Member:
+      while (child && !nameEquals(child->string, path + step.Name, step.NameLength))
+        child = child->next;
+      break;
+
+    case StepType::Index:
+      if (!cJSON_IsArray(item))
+        return nullptr;
+      for (int i = 0; child && i < step.Index; ++i)
+        child = child->next;
+      break;
+
+    case StepType::Match:
+      if (!cJSON_IsArray(item))
+        return nullptr;
+      for (; child; child = child->next)
+      {
+        cJSON const* attr = child->child;
+        while (attr && !nameEquals(attr->string, path + step.Name, step.NameLength))
+          attr = attr->next;
+
+        if (attr && cJSON_IsString(attr) &&
+            valueEquals(attr->valuestring, path + step.Value, step.ValueLength))
+          break;
+      }
+      break;
+  }
+  return child;
+}
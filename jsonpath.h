@@ -0,0 +1,82 @@
+//
+// Copyright [2018] [Comcast, Corp]
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#ifndef __JSON_PATH_H__
+#define __JSON_PATH_H__
+
+#include <string>
+#include <vector>
+
+#include <stddef.h>
+
+struct cJSON;
+
+// A path into a cJSON tree such as "/params/cred/pass". Each segment is an
+// object member, matched case insensitively like cJSON_GetObjectItem, and
+// may be followed by array predicates:
+//
+//   /services/[1]               second element of the services array
+//   /services[@name='wifi']     first element whose "name" is "wifi"
+//   /services[@name='wifi']/settings/interface
+//
+// A path that doesn't start with '/' names a single member as is.
+//
+// Constructing a JsonPath tokenizes it once, so fixed paths are best kept
+// in a static and reused. find() then walks the tree without allocating.
+// Malformed paths throw std::runtime_error.
+class JsonPath
+{
+public:
+  explicit JsonPath(char const* path);
+  explicit JsonPath(std::string const& path);
+
+  cJSON const* find(cJSON const* json) const;
+
+  char const* c_str() const
+    { return m_path.c_str(); }
+
+  // walks a path without compiling it first. Doesn't allocate either, but
+  // parses the path again on every call
+  static cJSON const* find(cJSON const* json, char const* path);
+
+private:
+  enum class StepType
+  {
+    Member,
+    Index,
+    Match
+  };
+
+  // offsets are into the path string so copies stay valid
+  struct Step
+  {
+    StepType  Type;
+    size_t    Name;
+    size_t    NameLength;
+    size_t    Value;
+    size_t    ValueLength;
+    int       Index;
+  };
+
+  static bool nextStep(char const* path, size_t& pos, Step& step);
+  static cJSON const* applyStep(cJSON const* item, char const* path, Step const& step);
+  void compile();
+
+private:
+  std::string       m_path;
+  std::vector<Step> m_steps;
+};
+
+#endif
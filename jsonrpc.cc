@@ -34,7 +34,52 @@
 
 namespace
 {
+  void throwNullJson(char const* name)
+  {
+    std::stringstream buff;
+    buff << "null json object when fetching field";
+    if (name)
+      buff << ":" << name;
+    throw std::runtime_error(buff.str());
+  }
+
+  void throwMissingField(cJSON const* json, char const* name)
+  {
+    XLOG_INFO("missing %s from the following json", name);
+    XLOG_JSON(RpcLogLevel::Info, json);
+
+    std::stringstream buff;
+    buff << "missing field ";
+    buff << name;
+    buff << " from object";
+    throw std::runtime_error(buff.str());
+  }
+
+  template<class Path>
+  int getIntImpl(cJSON const* json, Path const& path, bool required, int defaultValue)
+  {
+    int n = defaultValue;
+    cJSON const* item = JsonRpc::search(json, path, required);
+    if (item)
+      n = item->valueint;
+    return n;
+  }
+
+  template<class Path>
+  char const* getStringImpl(cJSON const* json, Path const& path, bool required,
+    char const* defaultValue)
+  {
+    char const* s = defaultValue;
+
+    cJSON const* item = JsonRpc::search(json, path, required);
+    if (item)
+      s = item->valuestring;
+
+    if (!s || (strcmp(s, "<null>") == 0))
+      s = NULL;
 
+    return s;
+  }
 }
 
 cJSON*
@@ -66,13 +111,7 @@ cJSON const*
 JsonRpc::search(cJSON const* json, char const* name, bool required)
 {
   if (!json)
-  {
-    std::stringstream buff;
-    buff << "null json object when fetching field";
-    if (name)
-      buff << ":" << name;
-    throw std::runtime_error(buff.str());
-  }
+    throwNullJson(name);
 
   if (!name || strlen(name) == 0)
   {
@@ -81,47 +120,22 @@ JsonRpc::search(cJSON const* json, char const* name, bool required)
     throw std::runtime_error(buff.str());
   }
 
-  cJSON const* item = nullptr;
-
-  if (name[0] == '/')
-  {
-    char* str = strdup(name + 1);
-    char* saveptr = nullptr;
-    char* token = nullptr;
-
-    item = json;
-    while ((token = strtok_r(str, "/", &saveptr)) != nullptr)
-    {
-      if (token == nullptr)
-        break;
-
-      item = cJSON_GetObjectItem(item, token);
-      if (!item)
-        break;
+  cJSON const* item = JsonPath::find(json, name);
+  if (!item && required)
+    throwMissingField(json, name);
 
-      str = nullptr;
-    }
+  return item;
+}
 
-    free(str);
-  }
-  else
-  {
-    item = cJSON_GetObjectItem(json, name);
-  }
+cJSON const*
+JsonRpc::search(cJSON const* json, JsonPath const& path, bool required)
+{
+  if (!json)
+    throwNullJson(path.c_str());
 
+  cJSON const* item = path.find(json);
   if (!item && required)
-  {
-    char* s = cJSON_Print(json);
-    XLOG_INFO("missing %s from the following json", name);
-    XLOG_INFO("%s", s);
-    free(s);
-
-    std::stringstream buff;
-    buff << "missing field ";
-    buff << name;
-    buff << " from object";
-    throw std::runtime_error(buff.str());
-  }
+    throwMissingField(json, path.c_str());
 
   return item;
 }
@@ -129,26 +143,25 @@ JsonRpc::search(cJSON const* json, char const* name, bool required)
 int
 JsonRpc::getInt(cJSON const* req, char const* name, bool required, int defaultValue)
 {
-  int n = defaultValue;
-  cJSON const* item = JsonRpc::search(req, name, required);
-  if (item)
-    n = item->valueint;
-  return n;
+  return getIntImpl(req, name, required, defaultValue);
+}
+
+int
+JsonRpc::getInt(cJSON const* req, JsonPath const& path, bool required, int defaultValue)
+{
+  return getIntImpl(req, path, required, defaultValue);
 }
 
 char const*
 JsonRpc::getString(cJSON const* req, char const* name, bool required, char const* defaultValue)
 {
-  char const* s = defaultValue;
-
-  cJSON const* item = JsonRpc::search(req, name, required);
-  if (item)
-    s = item->valuestring;
-
-  if (!s || (strcmp(s, "<null>") == 0))
-    s = NULL;
+  return getStringImpl(req, name, required, defaultValue);
+}
 
-  return s;
+char const*
+JsonRpc::getString(cJSON const* req, JsonPath const& path, bool required, char const* defaultValue)
+{
+  return getStringImpl(req, path, required, defaultValue);
 }
 
 std::string
@@ -226,147 +239,6 @@ jsonRpc_getBool(cJSON* argv, int idx)
   assert(false);
 }
 
-static bool
-jsonExtractArg(cJSON* obj, char const* spec, void* p)
-{
-  bool extracted = false;
-
-  char type;
-  char name[64];
-  char const* end;
-  char const* begin;
-  int length = -1;
-
-  begin = spec;
-  end = strchr(spec, ':');
-
-  memset(name, 0, sizeof(name));
-  strncpy(name, begin, (end - begin));
-
-  obj = cJSON_GetObjectItem(obj, name);
-  if (!obj)
-  {
-    char* str = cJSON_Print(obj);
-    XLOG_WARN("failed to find:%s in %s", name, str);
-    free(str);
-    return false;
-  }
-
-  begin = end + 1;
-  type = *begin++;
-
-  bool unsignedModifier = false;
-  if (*begin)
-  {
-    if (*begin == 'u')
-    {
-      unsignedModifier = true;
-    }
-    if (type == 's')
-      length = static_cast<int>(strtol(begin, NULL, 10));
-  }
-
-  switch (type)
-  {
-    case 's':
-    {
-      char* dest = reinterpret_cast<char *>(p);
-      if (length)
-        strncpy(dest, obj->valuestring, length);
-      else
-        strcpy(dest, obj->valuestring);
-      extracted = true;
-    }
-    break;
-
-    case 'l':
-    {
-      if (unsignedModifier)
-      {
-        unsigned long* lu = reinterpret_cast<unsigned long *>(p);
-        *lu = static_cast<unsigned long>(obj->valuedouble);
-      }
-      else
-      {
-        long* l = reinterpret_cast<long *>(p);
-        *l = static_cast<long>(obj->valuedouble);
-      }
-      extracted = true;
-    }
-    break;
-
-    case 'b':
-    {
-      bool* b = reinterpret_cast<bool *>(p);
-      *b = (obj->type == cJSON_True) ? true : false;
-      extracted = true;
-    }
-    break;
-
-    case 'f':
-    {
-      float* f = reinterpret_cast<float *>(p);
-      *f = static_cast<float>(obj->valuedouble);
-      extracted = true;
-    }
-    break;
-
-    case 'u':
-    {
-      uint32_t* u = reinterpret_cast<uint32_t *>(p);
-      *u = static_cast<uint32_t>(obj->valueint);
-      extracted = true;
-    }
-    break;
-
-    case 'd':
-    {
-      int32_t* i = reinterpret_cast<int32_t *>(p);
-      *i = obj->valueint;
-      extracted = true;
-    }
-    break;
-  }
-
-  return extracted;
-}
-
-int
-jsonRpc_scanf(cJSON* obj, char const* fmt, ...)
-{
-  int n = 0;
-
-  va_list ap;
-  va_start(ap, fmt);
-
-  char fmtSpec[2048];
-
-  while (*fmt)
-  {
-    char const* begin = fmt;
-    while (*begin && *begin != '{')
-      begin++;
-
-    if (*begin == '\0')
-      break;
-
-    char const* end = begin++;
-    while (end && *end != '}')
-      end++;
-
-    memset(fmtSpec, 0, sizeof(fmtSpec));
-    strncpy(fmtSpec, begin, (end - begin));
-
-    if (jsonExtractArg(obj, fmtSpec, va_arg(ap, void *)))
-      n++;
-
-    fmt = end;
-  }
-
-  va_end(ap);
-  return n;
-}
-
 int
 jsonRpc_binaryEncode(uint8_t const* buff, size_t len, std::string& encoded)
 {
@@ -19,6 +19,8 @@
 #include <cJSON.h>
 #include <string>
 
+#include "jsonpath.h"
+
 class JsonRpc
 {
 public:
@@ -33,6 +35,13 @@ public:
     bool          required = false,
     int           defaultValue = 0);
 
+  static int
+  getInt(
+    cJSON const*    json,
+    JsonPath const& path,
+    bool            required = false,
+    int             defaultValue = 0);
+
   static char const*
   getString(
     cJSON const*  json,
@@ -40,6 +49,13 @@ public:
     bool          required,
     char const*   defaultValue = nullptr);
 
+  static char const*
+  getString(
+    cJSON const*    json,
+    JsonPath const& path,
+    bool            required,
+    char const*     defaultValue = nullptr);
+
   static std::string
   getStringWithExpansion(
     cJSON const*  json,
@@ -54,6 +70,12 @@ public:
     char const*   name,
     bool          required);
 
+  static cJSON const*
+  search(
+    cJSON const*    json,
+    JsonPath const& path,
+    bool            required);
+
   static cJSON*
   fromFile(
     char const* fname);
@@ -0,0 +1,167 @@
+//
+// Copyright [2018] [Comcast, Corp]
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#include "jsonwriter.h"
+
+#include <cJSON.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+namespace
+{
+  inline void append(std::vector<char>& out, char const* s, size_t n)
+  {
+    out.insert(out.end(), s, s + n);
+  }
+
+  void writeString(char const* s, size_t len, std::vector<char>& out)
+  {
+    out.push_back('"');
+    if (s)
+    {
+      // copy runs that don't need escaping in one go
+      char const* run = s;
+      char const* end = s + len;
+      for (char const* p = s; p != end; ++p)
+      {
+        unsigned char c = static_cast<unsigned char>(*p);
+        if (c >= 32 && c != '"' && c != '\\')
+          continue;
+
+        append(out, run, p - run);
+        run = p + 1;
+
+        out.push_back('\\');
+        switch (c)
+        {
+          case '"':  out.push_back('"'); break;
+          case '\\': out.push_back('\\'); break;
+          case '\b': out.push_back('b'); break;
+          case '\f': out.push_back('f'); break;
+          case '\n': out.push_back('n'); break;
+          case '\r': out.push_back('r'); break;
+          case '\t': out.push_back('t'); break;
+          default:
+          {
+            char buff[8];
+            int n = snprintf(buff, sizeof(buff), "u%04x", c);
+            append(out, buff, n);
+          }
+          break;
+        }
+      }
+      append(out, run, end - run);
+    }
+    out.push_back('"');
+  }
+
+  inline void writeString(char const* s, std::vector<char>& out)
+  {
+    writeString(s, s ? strlen(s) : 0, out);
+  }
+
+  void writeNumber(double d, std::vector<char>& out)
+  {
+    char buff[32];
+    int n = 0;
+
+    if (d * 0 != 0)
+    {
+      // nan and inf aren't valid JSON
+      n = snprintf(buff, sizeof(buff), "null");
+    }
+    else if (d == floor(d) && fabs(d) < 1e15)
+    {
+      // same digits %1.15g gives for integral values, without the double
+      // round trip check
+      n = snprintf(buff, sizeof(buff), "%lld", static_cast<long long>(d));
+    }
+    else
+    {
+      n = snprintf(buff, sizeof(buff), "%1.15g", d);
+
+      double test = 0.0;
+      if (sscanf(buff, "%lg", &test) != 1 || test != d)
+        n = snprintf(buff, sizeof(buff), "%1.17g", d);
+    }
+
+    append(out, buff, n);
+  }
+
+  void writeValue(cJSON const* item, std::vector<char>& out)
+  {
+    switch (item->type & 0xff)
+    {
+      case cJSON_NULL:
+        append(out, "null", 4);
+        break;
+      case cJSON_False:
+        append(out, "false", 5);
+        break;
+      case cJSON_True:
+        append(out, "true", 4);
+        break;
+      case cJSON_Number:
+        writeNumber(item->valuedouble, out);
+        break;
+      case cJSON_String:
+        writeString(item->valuestring, out);
+        break;
+      case cJSON_Raw:
+        if (item->valuestring)
+          append(out, item->valuestring, strlen(item->valuestring));
+        break;
+      case cJSON_Array:
+        out.push_back('[');
+        for (cJSON const* child = item->child; child; child = child->next)
+        {
+          writeValue(child, out);
+          if (child->next)
+            out.push_back(',');
+        }
+        out.push_back(']');
+        break;
+      case cJSON_Object:
+        out.push_back('{');
+        for (cJSON const* child = item->child; child; child = child->next)
+        {
+          writeString(child->string, out);
+          out.push_back(':');
+          writeValue(child, out);
+          if (child->next)
+            out.push_back(',');
+        }
+        out.push_back('}');
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+void
+JsonWriter::write(cJSON const* json, std::vector<char>& out)
+{
+  if (json)
+    writeValue(json, out);
+}
+
+void
+JsonWriter::writeString(char const* s, size_t n, std::vector<char>& out)
+{
+  ::writeString(s, n, out);
+}
@@ -0,0 +1,38 @@
+//
+// Copyright [2018] [Comcast, Corp]
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#ifndef __JSON_WRITER_H__
+#define __JSON_WRITER_H__
+
+#include <vector>
+
+#include <stddef.h>
+
+struct cJSON;
+
+// Compact JSON serializer that appends straight into a caller owned buffer,
+// so a response can be written into the vector the transport queues without
+// an intermediate string. Output matches cJSON_PrintUnformatted.
+class JsonWriter
+{
+public:
+  static void write(cJSON const* json, std::vector<char>& out);
+
+  // quoted and escaped, for callers writing JSON by hand. s doesn't have to
+  // be null terminated
+  static void writeString(char const* s, size_t n, std::vector<char>& out);
+};
+
+#endif
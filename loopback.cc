@@ -0,0 +1,62 @@
+//
+// Copyright [2018] [Comcast, Corp]
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#include "loopback.h"
+#include "defs.h"
+#include "rpclogger.h"
+
+LoopbackClient::LoopbackClient()
+  : RpcConnectedClient()
+{
+}
+
+LoopbackClient::~LoopbackClient()
+{
+}
+
+void
+LoopbackClient::init(DeviceInfoProvider const& UNUSED_PARAM(deviceInfoProvider))
+{
+}
+
+void
+LoopbackClient::setDataHandler(RpcDataHandler const& handler)
+{
+  m_data_handler = handler;
+}
+
+void
+LoopbackClient::setResponseHandler(RpcDataHandler const& handler)
+{
+  m_response_handler = handler;
+}
+
+void
+LoopbackClient::enqueueForSend(char const* buff, int n)
+{
+  if (m_response_handler)
+    m_response_handler(buff, n);
+}
+
+void
+LoopbackClient::send(char const* buff, int n)
+{
+  if (!m_data_handler)
+  {
+    XLOG_WARN("loopback client isn't attached to a server");
+    return;
+  }
+  m_data_handler(buff, n);
+}
@@ -0,0 +1,47 @@
+//
+// Copyright [2018] [Comcast, Corp]
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#ifndef __LOOPBACK_H__
+#define __LOOPBACK_H__
+
+#include "rpcserver.h"
+
+// In-process transport. Requests go straight into the server's data handler
+// and every record the server sends is handed to the response handler on
+// the sending thread, so the whole request pipeline can be driven without a
+// socket or radio.
+class LoopbackClient : public RpcConnectedClient
+{
+public:
+  LoopbackClient();
+  virtual ~LoopbackClient();
+
+  virtual void init(DeviceInfoProvider const& deviceInfoProvider) override;
+  virtual void enqueueForSend(char const* buff, int n) override;
+  virtual void setDataHandler(RpcDataHandler const& handler) override;
+
+  // receives each record sent to this client, without a record separator
+  void setResponseHandler(RpcDataHandler const& handler);
+
+  // delivers a request as if it had been read off the wire. buff must be
+  // null terminated
+  void send(char const* buff, int n);
+
+private:
+  RpcDataHandler  m_data_handler;
+  RpcDataHandler  m_response_handler;
+};
+
+#endif
@@ -14,6 +14,9 @@
 // limitations under the License.
 //
 #include "defs.h"
+#include "jsonarena.h"
+#include "loopback.h"
+#include "reactor.h"
 #include "rpclogger.h"
 #include "rpcserver.h"
 #include "jsonrpc.h"
@@ -29,6 +32,7 @@
 #include <iostream>
 #include <fstream>
 #include <mutex>
+#include <stdexcept>
 #include <string>
 #include <cJSON.h>
 
@@ -50,33 +54,21 @@ static std::string getFullPath(std::string const& f)
   return (s != nullptr ? std::string(s) : f);
 }
 
-class SignalingConnectedClient : public RpcConnectedClient
+// methods that take a while send interim responses marked "progress":true
+// ahead of the one that ends the request. Notifications, such as wpa events,
+// carry a method instead
+static bool isFinalResponse(char const* buff, int n)
 {
-public:
-  SignalingConnectedClient()
-    : RpcConnectedClient()
-    , m_have_response(false) { }
-  virtual ~SignalingConnectedClient() { }
-  virtual void init(DeviceInfoProvider const& UNUSED_PARAM(deviceInfoProvider)) override { }
-  virtual void enqueueForSend(char const* UNUSED_PARAM(buff), int UNUSED_PARAM(n)) override
-  {
-    {
-      std::lock_guard<std::mutex> lock(m_mutex);
-      m_have_response = true;
-    }
-    m_cond.notify_one();
-  }
-  virtual void run() override
-  {
-    std::unique_lock<std::mutex> lock(m_mutex);
-    m_cond.wait(lock, [this] {return this->m_have_response;});
-  }
-  virtual void setDataHandler(RpcDataHandler const& UNUSED_PARAM(handler)) override { }
-private:
-  std::mutex              m_mutex;
-  std::condition_variable m_cond;
-  bool                    m_have_response;
-};
+  cJSON* res = cJSON_ParseWithOpts(std::string(buff, n).c_str(), nullptr, false);
+  if (!res)
+    return true;
+
+  bool isFinal = !cJSON_GetObjectItem(res, "method") &&
+    !cJSON_IsTrue(cJSON_GetObjectItem(res, "progress"));
+
+  cJSON_Delete(res);
+  return isFinal;
+}
 
 void
 printHelp()
@@ -92,8 +84,12 @@ printHelp()
 
 int main(int argc, char* argv[])
 {
+  // must come before anything touches cJSON
+  JsonArena::installHooks();
+
   cJSON* testInput = nullptr;
   std::string configFile = "bleconfd.json";
+  bool debugLogging = false;
   RpcLogger::logger().setLevel(RpcLogLevel::Info);
 
 
@@ -120,6 +116,7 @@ int main(int argc, char* argv[])
         break;
       case 'd':
         RpcLogger::logger().setLevel(RpcLogLevel::Debug);
+        debugLogging = true;
         break;
       case 't':
         testInput = JsonRpc::fromFile(optarg);
@@ -140,23 +137,76 @@ int main(int argc, char* argv[])
     return 1;
   }
 
+  // --debug wins over the configured level
+  char const* logLevel = JsonRpc::getString(config, "/log/level", false, nullptr);
+  if (logLevel && !debugLogging)
+  {
+    try
+    {
+      RpcLogger::logger().setLevel(RpcLogger::stringToLevel(logLevel));
+    }
+    catch (std::exception const& err)
+    {
+      XLOG_WARN("%s", err.what());
+    }
+  }
+
+  int jsonLimit = JsonRpc::getInt(config, "/log/json-max-length", false, -1);
+  if (jsonLimit >= 0)
+    RpcLogger::logger().setJsonLimit(static_cast<size_t>(jsonLimit));
+
   RpcServer server(configFile, config);
   XLOG_INFO("rpc server intialized");
 
   if (testInput)
   {
-    std::shared_ptr<RpcConnectedClient> client(new SignalingConnectedClient());
-    server.setClient(client);
+    // the client can outlive this block on a worker that's still sending, so
+    // what the handler touches is owned by the handler too
+    struct TestState
+    {
+      std::mutex              Mutex;
+      std::condition_variable Done;
+      bool                    HaveResponse;
+    };
+
+    std::shared_ptr<TestState> state(new TestState());
+    state->HaveResponse = false;
+
+    std::shared_ptr<LoopbackClient> client(new LoopbackClient());
+    client->setResponseHandler([state](char const* buff, int n)
+    {
+      printf("%.*s\n", n, buff);
+      if (!isFinalResponse(buff, n))
+        return;
+
+      {
+        std::lock_guard<std::mutex> lock(state->Mutex);
+        state->HaveResponse = true;
+      }
+      state->Done.notify_one();
+    });
+    server.addClient(client);
+
+    // there's no listener to drive the reactor in test mode, and services
+    // still need it for wpa events and child processes
+    std::thread reactorThread([] { Reactor::main().run(); });
 
     XLOG_INFO("starting test runner thread");
     std::thread testRunner([&] {
-//      std::this_thread::sleep_for(std::chrono::seconds(2));
       char* s = cJSON_PrintUnformatted(testInput);
-      server.onIncomingMessage(s, strlen(s));
-      free(s);
+      client->send(s, strlen(s));
+      cJSON_free(s);
     });
     testRunner.join();
-    server.run();
+
+    {
+      std::unique_lock<std::mutex> lock(state->Mutex);
+      state->Done.wait(lock, [&state] { return state->HaveResponse; });
+    }
+    server.removeClient(client);
+
+    Reactor::main().stop();
+    reactorThread.join();
   }
   else
   {
@@ -175,15 +225,17 @@ int main(int argc, char* argv[])
     {
       try
       {
-        std::shared_ptr<RpcListener> listener(RpcListener::create());
+        std::shared_ptr<RpcListener> listener(RpcListener::create(listenerConfig));
+        if (!listener)
+          return 1;
+
         listener->init(listenerConfig);
 
-        // blocks here until remote client makes BT connection
-        std::shared_ptr<RpcConnectedClient> client = listener->accept(deviceInfoProvider);
-        client->setDataHandler(std::bind(&RpcServer::onIncomingMessage,
-              &server, std::placeholders::_1, std::placeholders::_2));
-        server.setClient(client);
-        server.run();
+        // blocks here running the listener. Each remote client that connects
+        // gets its own session on the server and they're all served at once
+        listener->run(deviceInfoProvider,
+          [&server](std::shared_ptr<RpcConnectedClient> const& client) { server.addClient(client); },
+          [&server](std::shared_ptr<RpcConnectedClient> const& client) { server.removeClient(client); });
       }
       catch (std::runtime_error const& err)
       {
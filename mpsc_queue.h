@@ -0,0 +1,89 @@
+//
+// Copyright [2018] [Comcast, Corp]
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#include <atomic>
+#include <utility>
+
+#ifndef __MPSC_QUEUE_H__
+#define __MPSC_QUEUE_H__
+
+// Unbounded multi-producer single-consumer queue (Vyukov). push never
+// blocks or takes a lock, it's one atomic exchange. Only one thread may pop
+// at a time, callers that share the consumer side serialize it themselves.
+//
+// A push is visible to pop once the producer has linked its node. Until
+// then pop can return false even though another producer's later push has
+// finished, so a consumer that's woken for an item and doesn't find it will
+// be woken again by the producer that's still linking.
+template<class T>
+class mpsc_queue
+{
+public:
+  mpsc_queue()
+    : m_head(new node())
+    , m_tail(m_head.load(std::memory_order_relaxed))
+  {
+  }
+
+  ~mpsc_queue()
+  {
+    T value;
+    while (pop(value))
+      ;
+    delete m_tail;
+  }
+
+  mpsc_queue(mpsc_queue const&) = delete;
+  mpsc_queue& operator=(mpsc_queue const&) = delete;
+
+  void push(T&& value)
+  {
+    node* n = new node(std::move(value));
+    node* prev = m_head.exchange(n, std::memory_order_acq_rel);
+    prev->next.store(n, std::memory_order_release);
+  }
+
+  bool pop(T& value)
+  {
+    node* tail = m_tail;
+    node* next = tail->next.load(std::memory_order_acquire);
+    if (!next)
+      return false;
+
+    // next becomes the new stub node, its value has been moved out
+    value = std::move(next->value);
+    m_tail = next;
+    delete tail;
+    return true;
+  }
+
+private:
+  struct node
+  {
+    node()
+      : value()
+      , next(nullptr) { }
+    explicit node(T&& v)
+      : value(std::move(v))
+      , next(nullptr) { }
+    T                   value;
+    std::atomic<node*>  next;
+  };
+
+  std::atomic<node*>  m_head;
+  node*               m_tail;
+};
+
+#endif
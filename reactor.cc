@@ -0,0 +1,659 @@
+//
+// Copyright [2018] [Comcast, Corp]
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#include "reactor.h"
+#include "defs.h"
+#include "rpclogger.h"
+#include "util.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
+
+extern char** environ;
+
+namespace
+{
+  int const   kMaxEvents            {64};
+  int const   kMaxReadsPerEvent     {16};
+  size_t const kReadChunkSize       {4096};
+
+  // a handler taking longer than this holds up every other source
+  std::chrono::milliseconds const kSlowDispatch {100};
+
+  // how often a child is polled for having exited when there's no pidfd
+  std::chrono::milliseconds const kChildPollInterval {10};
+
+  long long
+  toMicros(std::chrono::nanoseconds t)
+  {
+    return static_cast<long long>(std::chrono::duration_cast<std::chrono::microseconds>(t).count());
+  }
+
+  int
+  openPidFd(pid_t pid)
+  {
+  #ifdef SYS_pidfd_open
+    return static_cast<int>(syscall(SYS_pidfd_open, pid, 0));
+  #else
+    (void) pid;
+    errno = ENOSYS;
+    return -1;
+  #endif
+  }
+}
+
+struct Reactor::Source
+{
+  uint32_t                  Id;
+  int                       Fd;
+  std::string               Name;
+  ReactorHandler            Handler;
+
+  // timers and child process fds are created by the reactor and closed when
+  // they're removed
+  bool                      Owned;
+
+  // both guarded by m_mutex
+  bool                      Running;
+  bool                      Removed;
+  uint64_t                  Dispatches;
+  std::chrono::nanoseconds  Total;
+  std::chrono::nanoseconds  Max;
+};
+
+struct Reactor::Child
+{
+  pid_t                     Pid;
+  int                       Status;
+  bool                      Exited;
+
+  // the pidfd, or the timer polling for exit when there isn't one
+  int                       ExitFd;
+
+  // stdout and stderr pipes not yet at end of file
+  int                       OpenPipes;
+  std::string               Out;
+  std::string               Err;
+  ReactorChildHandler       OnExit;
+};
+
+Reactor::Reactor()
+  : m_epoll_fd(-1)
+  , m_wakeup_fd(-1)
+  , m_stop(false)
+  , m_thread_id()
+  , m_mutex()
+  , m_dispatch_done()
+  , m_next_id(0)
+  , m_sources()
+  , m_tasks()
+{
+  m_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (m_epoll_fd < 0)
+    throw_errno(errno, "failed to create epoll fd");
+
+  m_wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (m_wakeup_fd < 0)
+    throw_errno(errno, "failed to create eventfd");
+
+  int ret = addSource(m_wakeup_fd, EPOLLIN, "wakeup", [this](uint32_t) { onWakeup(); }, true);
+  if (ret)
+    throw_errno(ret, "failed to add eventfd to epoll");
+}
+
+Reactor::~Reactor()
+{
+  for (auto& itr : m_sources)
+  {
+    if (itr.second->Owned)
+      close(itr.first);
+  }
+  m_sources.clear();
+
+  if (m_epoll_fd != -1)
+    close(m_epoll_fd);
+}
+
+Reactor&
+Reactor::main()
+{
+  static Reactor reactor;
+  return reactor;
+}
+
+int
+Reactor::addFd(int fd, uint32_t events, char const* name, ReactorHandler const& handler)
+{
+  return addSource(fd, events, name, handler, false);
+}
+
+int
+Reactor::addSource(int fd, uint32_t events, char const* name, ReactorHandler const& handler,
+  bool owned)
+{
+  std::shared_ptr<Source> source(new Source());
+  source->Fd = fd;
+  source->Name = name;
+  source->Handler = handler;
+  source->Owned = owned;
+  source->Running = false;
+  source->Removed = false;
+  source->Dispatches = 0;
+  source->Total = std::chrono::nanoseconds::zero();
+  source->Max = std::chrono::nanoseconds::zero();
+
+  std::lock_guard<std::mutex> guard(m_mutex);
+  source->Id = ++m_next_id;
+
+  // the id tells apart an event for a source that was removed from one for
+  // a new source that's been given the same fd number since epoll_wait
+  epoll_event event;
+  memset(&event, 0, sizeof(event));
+  event.events = events;
+  event.data.u64 = (static_cast<uint64_t>(source->Id) << 32) | static_cast<uint32_t>(fd);
+  if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0)
+  {
+    int err = errno;
+    XLOG_WARN("failed to add %s:%d to epoll. %s", name, fd, strerror(err));
+    return err;
+  }
+
+  m_sources[fd] = source;
+  return 0;
+}
+
+int
+Reactor::modifyFd(int fd, uint32_t events)
+{
+  std::lock_guard<std::mutex> guard(m_mutex);
+
+  auto itr = m_sources.find(fd);
+  if (itr == m_sources.end())
+    return ENOENT;
+
+  epoll_event event;
+  memset(&event, 0, sizeof(event));
+  event.events = events;
+  event.data.u64 = (static_cast<uint64_t>(itr->second->Id) << 32) | static_cast<uint32_t>(fd);
+  if (epoll_ctl(m_epoll_fd, EPOLL_CTL_MOD, fd, &event) < 0)
+  {
+    int err = errno;
+    XLOG_WARN("failed to update epoll events for %s:%d. %s", itr->second->Name.c_str(), fd,
+      strerror(err));
+    return err;
+  }
+
+  return 0;
+}
+
+int
+Reactor::removeFd(int fd)
+{
+  std::shared_ptr<Source> source;
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    auto itr = m_sources.find(fd);
+    if (itr == m_sources.end())
+      return ENOENT;
+
+    source = itr->second;
+    m_sources.erase(itr);
+    source->Removed = true;
+
+    epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+
+    // a handler removing its own source is still on the stack
+    if (!inLoopThread())
+      m_dispatch_done.wait(lock, [&source] { return !source->Running; });
+  }
+
+  if (source->Owned)
+    close(fd);
+
+  XLOG_DEBUG("removed %s:%d after %llu dispatches, %lldus total, %lldus max",
+    source->Name.c_str(), fd, static_cast<unsigned long long>(source->Dispatches),
+    toMicros(source->Total), toMicros(source->Max));
+
+  return 0;
+}
+
+int
+Reactor::addTimer(std::chrono::milliseconds interval, bool repeat, char const* name,
+  ReactorTask const& task)
+{
+  int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (fd < 0)
+  {
+    XLOG_WARN("failed to create timer %s. %s", name, strerror(errno));
+    return -1;
+  }
+
+  // an all zero it_value disarms the timer rather than firing it now
+  if (interval.count() <= 0)
+    interval = std::chrono::milliseconds(1);
+
+  itimerspec spec;
+  memset(&spec, 0, sizeof(spec));
+  spec.it_value.tv_sec = interval.count() / 1000;
+  spec.it_value.tv_nsec = (interval.count() % 1000) * 1000000;
+  if (repeat)
+    spec.it_interval = spec.it_value;
+
+  if (timerfd_settime(fd, 0, &spec, nullptr) < 0)
+  {
+    XLOG_WARN("failed to arm timer %s. %s", name, strerror(errno));
+    close(fd);
+    return -1;
+  }
+
+  int ret = addSource(fd, EPOLLIN, name, [this, fd, repeat, task](uint32_t)
+  {
+    uint64_t expirations = 0;
+    if (read(fd, &expirations, sizeof(expirations)) < 0)
+      return;
+    if (!repeat)
+      removeFd(fd);
+    task();
+  }, true);
+
+  if (ret)
+  {
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+void
+Reactor::removeTimer(int id)
+{
+  removeFd(id);
+}
+
+void
+Reactor::post(ReactorTask&& task)
+{
+  m_tasks.push(std::move(task));
+
+  uint64_t one = 1;
+  if (write(m_wakeup_fd, &one, sizeof(one)) < 0)
+    XLOG_WARN("failed to signal reactor. %s", strerror(errno));
+}
+
+void
+Reactor::onWakeup()
+{
+  uint64_t n = 0;
+  if (read(m_wakeup_fd, &n, sizeof(n)) < 0 && errno != EAGAIN)
+    XLOG_WARN("failed to read eventfd. %s", strerror(errno));
+
+  ReactorTask task;
+  while (m_tasks.pop(task))
+  {
+    task();
+    task = nullptr;
+  }
+}
+
+void
+Reactor::run()
+{
+  while (!m_stop)
+    runOnce(-1);
+}
+
+void
+Reactor::stop()
+{
+  m_stop = true;
+
+  uint64_t one = 1;
+  if (write(m_wakeup_fd, &one, sizeof(one)) < 0)
+    XLOG_WARN("failed to signal reactor. %s", strerror(errno));
+}
+
+bool
+Reactor::inLoopThread() const
+{
+  return m_thread_id.load() == std::this_thread::get_id();
+}
+
+int
+Reactor::runOnce(int timeout)
+{
+  m_thread_id = std::this_thread::get_id();
+
+  epoll_event events[kMaxEvents];
+  int n = epoll_wait(m_epoll_fd, events, kMaxEvents, timeout);
+  if (n < 0)
+  {
+    if (errno == EINTR)
+      return 0;
+    throw_errno(errno, "epoll_wait failed");
+  }
+
+  for (int i = 0; i < n; ++i)
+  {
+    uint32_t id = static_cast<uint32_t>(events[i].data.u64 >> 32);
+    int fd = static_cast<int>(events[i].data.u64 & 0xffffffff);
+
+    std::shared_ptr<Source> source;
+    {
+      std::lock_guard<std::mutex> guard(m_mutex);
+      auto itr = m_sources.find(fd);
+      if (itr != m_sources.end() && itr->second->Id == id)
+        source = itr->second;
+    }
+
+    if (source)
+      dispatch(source, events[i].events);
+  }
+
+  return n;
+}
+
+void
+Reactor::dispatch(std::shared_ptr<Source> const& source, uint32_t events)
+{
+  {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    if (source->Removed)
+      return;
+    source->Running = true;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  try
+  {
+    source->Handler(events);
+  }
+  catch (std::exception const& err)
+  {
+    XLOG_ERROR("unhandled exception from %s:%d. %s", source->Name.c_str(), source->Fd,
+      err.what());
+  }
+  std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+
+  {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    source->Running = false;
+    source->Dispatches++;
+    source->Total += elapsed;
+    if (elapsed > source->Max)
+      source->Max = elapsed;
+  }
+  m_dispatch_done.notify_all();
+
+  if (elapsed > kSlowDispatch)
+    XLOG_WARN("%s:%d held the reactor for %lldus", source->Name.c_str(), source->Fd,
+      toMicros(elapsed));
+}
+
+std::vector<ReactorSourceStats>
+Reactor::stats() const
+{
+  std::vector<ReactorSourceStats> stats;
+
+  std::lock_guard<std::mutex> guard(m_mutex);
+  stats.reserve(m_sources.size());
+  for (auto const& itr : m_sources)
+  {
+    ReactorSourceStats s;
+    s.Name = itr.second->Name;
+    s.Dispatches = itr.second->Dispatches;
+    s.Total = itr.second->Total;
+    s.Max = itr.second->Max;
+    stats.push_back(s);
+  }
+  return stats;
+}
+
+int
+Reactor::spawn(std::string const& cmdline, ReactorChildHandler const& onExit, pid_t* pidOut)
+{
+  int out[2] = {-1, -1};
+  int err[2] = {-1, -1};
+  if (pipe2(out, O_CLOEXEC) < 0)
+    return errno;
+  if (pipe2(err, O_CLOEXEC) < 0)
+  {
+    int ret = errno;
+    close(out[0]);
+    close(out[1]);
+    return ret;
+  }
+
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+  posix_spawn_file_actions_adddup2(&actions, out[1], STDOUT_FILENO);
+  posix_spawn_file_actions_adddup2(&actions, err[1], STDERR_FILENO);
+
+  // the shell leads a process group of its own so whatever it starts can be
+  // killed along with it
+  posix_spawnattr_t attr;
+  posix_spawnattr_init(&attr);
+  posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP);
+  posix_spawnattr_setpgroup(&attr, 0);
+
+  char const* argv[] = { "sh", "-c", cmdline.c_str(), nullptr };
+
+  pid_t pid = -1;
+  int ret = posix_spawn(&pid, "/bin/sh", &actions, &attr, const_cast<char* const*>(argv),
+    environ);
+  posix_spawnattr_destroy(&attr);
+  posix_spawn_file_actions_destroy(&actions);
+
+  close(out[1]);
+  close(err[1]);
+
+  if (ret)
+  {
+    close(out[0]);
+    close(err[0]);
+    return ret;
+  }
+
+  // only our end is non-blocking, the child's side of the pipe isn't
+  fcntl(out[0], F_SETFL, fcntl(out[0], F_GETFL, 0) | O_NONBLOCK);
+  fcntl(err[0], F_SETFL, fcntl(err[0], F_GETFL, 0) | O_NONBLOCK);
+
+  std::shared_ptr<Child> child(new Child());
+  child->Pid = pid;
+  child->Status = -1;
+  child->Exited = false;
+  child->ExitFd = -1;
+  child->OpenPipes = 0;
+  child->OnExit = onExit;
+
+  XLOG_DEBUG("spawned pid:%d for:%s", static_cast<int>(pid), cmdline.c_str());
+
+  if (pidOut)
+    *pidOut = pid;
+
+  // everything to do with the child happens on the loop from here
+  int stdout_fd = out[0];
+  int stderr_fd = err[0];
+  post([this, child, stdout_fd, stderr_fd] { watchChild(child, stdout_fd, stderr_fd); });
+
+  return 0;
+}
+
+void
+Reactor::watchChild(std::shared_ptr<Child> const& child, int out, int err)
+{
+  if (addSource(out, EPOLLIN, "child-stdout",
+    [this, child, out](uint32_t) { readChildPipe(child, out, &Child::Out); }, true) == 0)
+    child->OpenPipes++;
+  else
+    close(out);
+
+  if (addSource(err, EPOLLIN, "child-stderr",
+    [this, child, err](uint32_t) { readChildPipe(child, err, &Child::Err); }, true) == 0)
+    child->OpenPipes++;
+  else
+    close(err);
+
+  int pidfd = openPidFd(child->Pid);
+  if (pidfd != -1)
+  {
+    fcntl(pidfd, F_SETFD, FD_CLOEXEC);
+    if (addSource(pidfd, EPOLLIN, "child-exit", [this, child](uint32_t) { reapChild(child); },
+      true) == 0)
+    {
+      child->ExitFd = pidfd;
+      return;
+    }
+    close(pidfd);
+  }
+
+  child->ExitFd = addTimer(kChildPollInterval, true, "child-exit", [this, child]
+  {
+    reapChild(child);
+  });
+
+  if (child->ExitFd == -1)
+  {
+    // nothing left to watch it with, wait for it here
+    XLOG_WARN("can't watch pid:%d, waiting for it to exit", static_cast<int>(child->Pid));
+    waitpid(child->Pid, &child->Status, 0);
+    child->Exited = true;
+    finishChild(child);
+  }
+}
+
+void
+Reactor::readChildPipe(std::shared_ptr<Child> const& child, int fd, std::string Child::*buff)
+{
+  char chunk[kReadChunkSize];
+
+  for (int i = 0; i < kMaxReadsPerEvent; ++i)
+  {
+    ssize_t n = read(fd, chunk, sizeof(chunk));
+    if (n > 0)
+    {
+      ((*child).*buff).append(chunk, n);
+      continue;
+    }
+
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      return;
+
+    if (n < 0)
+      XLOG_WARN("error reading output of pid:%d. %s", static_cast<int>(child->Pid),
+        strerror(errno));
+
+    removeFd(fd);
+    child->OpenPipes--;
+    finishChild(child);
+    return;
+  }
+}
+
+void
+Reactor::reapChild(std::shared_ptr<Child> const& child)
+{
+  int status = 0;
+  pid_t pid = waitpid(child->Pid, &status, WNOHANG);
+  if (pid == 0)
+    return;
+
+  if (pid < 0)
+    XLOG_WARN("failed to wait for pid:%d. %s", static_cast<int>(child->Pid), strerror(errno));
+  else
+    child->Status = status;
+
+  removeFd(child->ExitFd);
+  child->ExitFd = -1;
+  child->Exited = true;
+  finishChild(child);
+}
+
+void
+Reactor::finishChild(std::shared_ptr<Child> const& child)
+{
+  // a child that has exited can leave its output behind in the pipes, and
+  // one that has closed them may still be running
+  if (!child->Exited || child->OpenPipes > 0 || !child->OnExit)
+    return;
+
+  ReactorChildHandler onExit;
+  onExit.swap(child->OnExit);
+  onExit(child->Status, child->Out, child->Err);
+}
+
+int
+Reactor::runProcess(std::string const& cmdline, std::chrono::milliseconds timeout,
+  int& status, std::string& out, std::string& err)
+{
+  if (inLoopThread())
+    return EDEADLK;
+
+  // shared with onExit, which still runs on the loop after a child that
+  // timed out has been killed and this has returned
+  struct Result
+  {
+    std::mutex              Mutex;
+    std::condition_variable Exited;
+    bool                    Done;
+    int                     Status;
+    std::string             Out;
+    std::string             Err;
+  };
+
+  std::shared_ptr<Result> result(new Result());
+  result->Done = false;
+  result->Status = -1;
+
+  pid_t pid = -1;
+  int ret = spawn(cmdline, [result](int s, std::string const& o, std::string const& e)
+  {
+    std::lock_guard<std::mutex> guard(result->Mutex);
+    result->Status = s;
+    result->Out = o;
+    result->Err = e;
+    result->Done = true;
+    result->Exited.notify_one();
+  }, &pid);
+  if (ret)
+    return ret;
+
+  std::unique_lock<std::mutex> lock(result->Mutex);
+  if (!result->Exited.wait_for(lock, timeout, [&result] { return result->Done; }))
+  {
+    XLOG_WARN("pid:%d didn't exit within %lldms, killing it. %s", static_cast<int>(pid),
+      static_cast<long long>(timeout.count()), cmdline.c_str());
+    kill(-pid, SIGKILL);
+    return ETIMEDOUT;
+  }
+
+  status = result->Status;
+  out.swap(result->Out);
+  err.swap(result->Err);
+  return 0;
+}
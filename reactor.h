@@ -0,0 +1,139 @@
+//
+// Copyright [2018] [Comcast, Corp]
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#ifndef __REACTOR_H__
+#define __REACTOR_H__
+
+#include "mpsc_queue.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/types.h>
+
+using ReactorHandler = std::function<void (uint32_t events)>;
+using ReactorTask = std::function<void ()>;
+
+// exit status as returned by waitpid, and everything the child wrote
+using ReactorChildHandler = std::function<void (int status, std::string const& out,
+  std::string const& err)>;
+
+struct ReactorSourceStats
+{
+  std::string Name;
+  uint64_t    Dispatches;
+
+  // time spent in the source's handler
+  std::chrono::nanoseconds Total;
+  std::chrono::nanoseconds Max;
+};
+
+// One epoll loop that every file descriptor the daemon waits on is
+// registered with: sockets, timerfds, child process pidfds and pipes, and
+// an eventfd that other threads use to post work onto the loop. Handlers
+// are all called on the thread running the loop, and each source is timed
+// the same way so a slow one shows up in the log.
+//
+// The loop is run either by itself with run(), or nested inside another
+// loop by watching fd() and calling runOnce(0) when it's readable.
+class Reactor
+{
+public:
+  Reactor();
+  ~Reactor();
+
+  Reactor(Reactor const&) = delete;
+  Reactor& operator=(Reactor const&) = delete;
+
+  // the reactor the daemon's listener and services share
+  static Reactor& main();
+
+  // the epoll fd, readable whenever there's something to dispatch
+  int fd() const
+    { return m_epoll_fd; }
+
+  // these can be called from any thread. A handler may add, modify or
+  // remove sources, including its own. Once removeFd returns on any other
+  // thread the source's handler isn't running and won't be called again
+  int addFd(int fd, uint32_t events, char const* name, ReactorHandler const& handler);
+  int modifyFd(int fd, uint32_t events);
+  int removeFd(int fd);
+
+  // returns the timer's fd, which is what's passed to removeTimer
+  int addTimer(std::chrono::milliseconds interval, bool repeat, char const* name,
+    ReactorTask const& task);
+  void removeTimer(int id);
+
+  // runs task on the loop's thread
+  void post(ReactorTask&& task);
+
+  // runs cmdline with /bin/sh in a process group of its own, whose id is
+  // returned in pid. Its output is collected on the loop and onExit is
+  // called there once it has exited and closed both pipes
+  int spawn(std::string const& cmdline, ReactorChildHandler const& onExit,
+    pid_t* pid = nullptr);
+
+  // spawn for a thread other than the loop's, waits for the child to exit.
+  // Its process group is killed and ETIMEDOUT returned if that takes longer
+  // than timeout. Returns EDEADLK when called on the loop's thread
+  int runProcess(std::string const& cmdline, std::chrono::milliseconds timeout,
+    int& status, std::string& out, std::string& err);
+
+  void run();
+  void stop();
+
+  // dispatches whatever is ready, waiting at most timeout milliseconds for
+  // something to be. Returns the number of events handled
+  int runOnce(int timeout);
+
+  bool inLoopThread() const;
+
+  std::vector<ReactorSourceStats> stats() const;
+
+private:
+  struct Source;
+  struct Child;
+
+  int addSource(int fd, uint32_t events, char const* name, ReactorHandler const& handler,
+    bool owned);
+  void onWakeup();
+  void dispatch(std::shared_ptr<Source> const& source, uint32_t events);
+  void watchChild(std::shared_ptr<Child> const& child, int out, int err);
+  void readChildPipe(std::shared_ptr<Child> const& child, int fd, std::string Child::*buff);
+  void reapChild(std::shared_ptr<Child> const& child);
+  void finishChild(std::shared_ptr<Child> const& child);
+
+private:
+  int                                                 m_epoll_fd;
+  int                                                 m_wakeup_fd;
+  std::atomic<bool>                                   m_stop;
+  std::atomic<std::thread::id>                        m_thread_id;
+  mutable std::mutex                                  m_mutex;
+  std::condition_variable                             m_dispatch_done;
+  uint32_t                                            m_next_id;
+  std::unordered_map< int, std::shared_ptr<Source> >  m_sources;
+  mpsc_queue<ReactorTask>                             m_tasks;
+};
+
+#endif
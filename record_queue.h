@@ -0,0 +1,210 @@
+//
+// Copyright [2018] [Comcast, Corp]
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <vector>
+#include <string.h>
+
+#ifndef __RECORD_QUEUE_H__
+#define __RECORD_QUEUE_H__
+
+// Outbound queue of delimiter terminated records. Each record is kept in one
+// contiguous chunk that is either copied in once or moved in from the caller.
+// Reads consume the record at the front of the queue and never return bytes
+// from two different records in the same call.
+//
+// A record can also be queued in parts with put_partial, so readers can start
+// on it before the rest has been written. Whole records put while one is
+// open are held back until its last part is in.
+class record_queue
+{
+public:
+  record_queue(char delim)
+    : m_records()
+    , m_held()
+    , m_read_offset(0)
+    , m_size(0)
+    , m_held_size(0)
+    , m_open(false)
+    , m_mutex()
+    , m_drained()
+    , m_delimiter(delim)
+  {
+  }
+
+  int get_line(char* s, int n)
+  {
+    if (!s || n <= 0)
+      return 0;
+
+    std::lock_guard<std::mutex> guard(m_mutex);
+    if (m_records.empty())
+      return 0;
+
+    std::vector<char>& record = m_records.front();
+
+    size_t bytes_read = record.size() - m_read_offset;
+    if (bytes_read > static_cast<size_t>(n))
+      bytes_read = static_cast<size_t>(n);
+
+    memcpy(s, &record[m_read_offset], bytes_read);
+    m_read_offset += bytes_read;
+    m_size -= bytes_read;
+
+    if (m_read_offset == record.size())
+    {
+      m_records.pop_front();
+      m_read_offset = 0;
+    }
+
+    m_drained.notify_all();
+    return static_cast<int>(bytes_read);
+  }
+
+  // copies what get_line would return without consuming it, so a reader
+  // that fails to pass the bytes on can leave them queued. consume commits
+  // the read. Only the reader touches the front record, so nothing a writer
+  // does in between changes what was peeked
+  int peek_line(char* s, int n) const
+  {
+    if (!s || n <= 0)
+      return 0;
+
+    std::lock_guard<std::mutex> guard(m_mutex);
+    if (m_records.empty())
+      return 0;
+
+    std::vector<char> const& record = m_records.front();
+
+    size_t bytes_read = record.size() - m_read_offset;
+    if (bytes_read > static_cast<size_t>(n))
+      bytes_read = static_cast<size_t>(n);
+
+    memcpy(s, &record[m_read_offset], bytes_read);
+    return static_cast<int>(bytes_read);
+  }
+
+  void consume(int n)
+  {
+    if (n <= 0)
+      return;
+
+    std::lock_guard<std::mutex> guard(m_mutex);
+    if (m_records.empty())
+      return;
+
+    std::vector<char>& record = m_records.front();
+
+    size_t bytes_read = record.size() - m_read_offset;
+    if (bytes_read > static_cast<size_t>(n))
+      bytes_read = static_cast<size_t>(n);
+
+    m_read_offset += bytes_read;
+    m_size -= bytes_read;
+
+    if (m_read_offset == record.size())
+    {
+      m_records.pop_front();
+      m_read_offset = 0;
+    }
+
+    m_drained.notify_all();
+  }
+
+  void put_line(char const* s, int n)
+  {
+    if (!s || n < 0)
+      return;
+
+    std::vector<char> record;
+    record.reserve(n + 1);
+    record.insert(record.end(), s, s + n);
+    put_line(std::move(record));
+  }
+
+  // takes ownership of the buffer, the delimiter is appended here so
+  // callers that reserve one extra byte avoid a reallocation
+  void put_line(std::vector<char>&& record)
+  {
+    record.push_back(m_delimiter);
+
+    std::lock_guard<std::mutex> guard(m_mutex);
+    if (m_open)
+    {
+      m_held_size += record.size();
+      m_held.push_back(std::move(record));
+    }
+    else
+    {
+      m_size += record.size();
+      m_records.push_back(std::move(record));
+    }
+  }
+
+  // queues the next part of an open record, or starts one. The delimiter is
+  // appended to the last part. Only one writer may have a record open
+  void put_partial(std::vector<char>&& part, bool last)
+  {
+    if (last)
+      part.push_back(m_delimiter);
+
+    std::lock_guard<std::mutex> guard(m_mutex);
+    if (!part.empty())
+    {
+      m_size += part.size();
+      m_records.push_back(std::move(part));
+    }
+
+    m_open = !last;
+    if (last)
+    {
+      for (auto& record : m_held)
+        m_records.push_back(std::move(record));
+      m_held.clear();
+      m_size += m_held_size;
+      m_held_size = 0;
+    }
+  }
+
+  // blocks until no more than limit bytes are waiting to be read. false if
+  // that didn't happen within timeout
+  bool wait_for_space(size_t limit, std::chrono::milliseconds timeout)
+  {
+    std::unique_lock<std::mutex> guard(m_mutex);
+    return m_drained.wait_for(guard, timeout, [this, limit] { return m_size <= limit; });
+  }
+
+  int size() const
+  {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    return static_cast<int>(m_size);
+  }
+
+private:
+  std::deque< std::vector<char> > m_records;
+  std::deque< std::vector<char> > m_held;
+  size_t                          m_read_offset;
+  size_t                          m_size;
+  size_t                          m_held_size;
+  bool                            m_open;
+  mutable std::mutex              m_mutex;
+  std::condition_variable         m_drained;
+  char                            m_delimiter;
+};
+
+#endif
@@ -14,8 +14,10 @@
 // limitations under the License.
 //
 #include "rpclogger.h"
+#include "jsonwriter.h"
 
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdexcept>
@@ -25,6 +27,7 @@
 #include <sys/syscall.h>
 #include <sys/time.h>
 #include <mutex>
+#include <vector>
 
 namespace
 {
@@ -47,6 +50,18 @@ namespace
 
   int const kNumMappings = sizeof(mappings) / sizeof(LevelMapping);
   char const* kUnknownMapping = "UNKNOWN";
+  size_t const kDefaultJsonLimit = 1024;
+
+  uint32_t fnv1a(char const* s, size_t n)
+  {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < n; ++i)
+    {
+      h ^= static_cast<unsigned char>(s[i]);
+      h *= 16777619u;
+    }
+    return h;
+  }
 
   int toSyslogPriority(RpcLogLevel level)
   {
@@ -105,6 +120,31 @@ RpcLogger::log(RpcLogLevel level, char const* /*file*/, int /*line*/, char const
   }
 }
 
+void
+RpcLogger::logJson(RpcLogLevel level, int line, char const* prefix, cJSON const* json)
+{
+  if (!json)
+  {
+    log(level, "", line, "%snull", prefix);
+    return;
+  }
+
+  std::vector<char> buff;
+  JsonWriter::write(json, buff);
+
+  if (m_json_limit > 0 && buff.size() > m_json_limit)
+  {
+    log(level, "", line, "%s%.*s... (%zu bytes, fnv1a:%08x)", prefix,
+      static_cast<int>(m_json_limit), &buff[0], buff.size(),
+      fnv1a(&buff[0], buff.size()));
+  }
+  else
+  {
+    log(level, "", line, "%s%.*s", prefix, static_cast<int>(buff.size()),
+      buff.empty() ? "" : &buff[0]);
+  }
+}
+
 char const*
 RpcLogger::levelToString(RpcLogLevel level)
 {
@@ -140,6 +180,7 @@ RpcLogger::logger()
 RpcLogger::RpcLogger()
   : m_level(RpcLogLevel::Info)
   , m_dest(RpcLogDestination::Stdout)
+  , m_json_limit(kDefaultJsonLimit)
 {
 
 }
@@ -153,3 +194,8 @@ void RpcLogger::setDestination(RpcLogDestination dest)
 {
   m_dest = dest;
 }
+
+void RpcLogger::setJsonLimit(size_t limit)
+{
+  m_json_limit = limit;
+}
@@ -17,6 +17,9 @@
 #define __LOGGER_H__
 
 #include <stdio.h>
+#include <stddef.h>
+
+struct cJSON;
 
 enum class RpcLogLevel
 {
@@ -42,9 +45,18 @@ public:
   inline bool isLevelEnabled(RpcLogLevel level)
     { return level <= m_level; }
 
+  // renders json compactly, payloads longer than the json limit are cut
+  // short and tagged with their full length and a hash so repeated payloads
+  // can still be told apart. callers go through XLOG_JSON so nothing is
+  // rendered unless the level is enabled
+  void logJson(RpcLogLevel level, int line, char const* prefix, cJSON const* json);
+
   void setLevel(RpcLogLevel level);
   void setDestination(RpcLogDestination dest);
 
+  // max bytes of json written per log line, zero for no limit
+  void setJsonLimit(size_t limit);
+
   static char const* levelToString(RpcLogLevel level);
   static RpcLogLevel stringToLevel(char const* level);
 
@@ -56,6 +68,7 @@ private:
 private:
   RpcLogLevel       m_level;
   RpcLogDestination m_dest;
+  size_t            m_json_limit;
 };
 
 #define XLOG(LEVEL, FORMAT, ...) \
@@ -70,11 +83,11 @@ private:
 #define XLOG_CRITICAL(FORMAT, ...) XLOG(RpcLogLevel::Critical, FORMAT, ##__VA_ARGS__)
 #define XLOG_FATAL(FORMAT, ...) XLOG(RpcLogLevel::Critical, FORMAT, ##__VA_ARGS__)
 
-#define XLOG_JSON(LEVEL, JSON) \
-  do { if (RpcLogger::logger().isLevelEnabled(LEVEL)) {\
-    char* s = cJSON_Print(JSON); \
-    RpcLogger::logger().log(LEVEL, "", __LINE__ -2, "%s", s); \
-    free(s); \
+#define XLOG_JSON_MSG(LEVEL, PREFIX, JSON) \
+  do { if (RpcLogger::logger().isLevelEnabled(LEVEL)) { \
+    RpcLogger::logger().logJson(LEVEL, __LINE__, PREFIX, JSON); \
   } } while (0)
 
+#define XLOG_JSON(LEVEL, JSON) XLOG_JSON_MSG(LEVEL, "", JSON)
+
 #endif
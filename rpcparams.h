@@ -0,0 +1,319 @@
+//
+// Copyright [2018] [Comcast, Corp]
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#ifndef __RPC_PARAMS_H__
+#define __RPC_PARAMS_H__
+
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <ctype.h>
+#include <stdint.h>
+#include <strings.h>
+
+#include <cJSON.h>
+
+#include "defs.h"
+
+// Typed binding of a request's "params" object onto a plain struct. A
+// method describes its params once, with a member pointer per field:
+//
+//   struct ConnectParams
+//   {
+//     char const* Ssid;
+//     char const* Pass;
+//
+//     static RpcParams<ConnectParams> const& params()
+//     {
+//       static RpcParams<ConnectParams> const p = RpcParams<ConnectParams>()
+//         .field("ssid", &ConnectParams::Ssid)
+//         .field("pass", &ConnectParams::Pass);
+//       return p;
+//     }
+//   };
+//
+// bind() then makes a single pass over the members of the object, matching
+// names case insensitively like cJSON_GetObjectItem, and fills in every
+// field it knows about. The code that checks and extracts each field is
+// instantiated from RpcParamTraits for the field's type, so nothing is
+// looked up by path at runtime. Members that aren't described are ignored
+// and the first of any duplicates wins.
+//
+// Supported field types are char const*, int, double, bool, cJSON const*
+// for values passed through as is, and any struct that has its own
+// params(). Strings and cJSON values point into the request and are only
+// valid while it's being handled.
+
+template<class P> class RpcParams;
+
+// where a value sits within params. Built on the stack as bind() descends
+// and only turned into a string when there's an error to report
+struct RpcParamPath
+{
+  char const*         Name;
+  RpcParamPath const* Parent;
+
+  std::string toString() const
+  {
+    if (!Parent)
+      return Name;
+    return Parent->toString() + '/' + Name;
+  }
+};
+
+namespace rpc_params_detail
+{
+  inline cJSON* typeSchema(char const* type)
+  {
+    cJSON* schema = cJSON_CreateObject();
+    if (type)
+      cJSON_AddItemToObject(schema, "type", cJSON_CreateString(type));
+    return schema;
+  }
+
+  inline void typeError(RpcParamPath const& path, char const* what, std::string& error)
+  {
+    error = path.toString();
+    error += " must be ";
+    error += what;
+  }
+}
+
+// nested params object, T must have a static params()
+template<class T>
+struct RpcParamTraits
+{
+  static bool bind(cJSON const* json, T& value, RpcParamPath const& path, std::string& error)
+    { return T::params().bind(json, value, path, error); }
+  static cJSON* schema()
+    { return T::params().schema(); }
+};
+
+template<>
+struct RpcParamTraits<char const*>
+{
+  static bool bind(cJSON const* json, char const*& value, RpcParamPath const& path, std::string& error)
+  {
+    if (!cJSON_IsString(json))
+    {
+      rpc_params_detail::typeError(path, "a string", error);
+      return false;
+    }
+    value = json->valuestring;
+    return true;
+  }
+  static cJSON* schema()
+    { return rpc_params_detail::typeSchema("string"); }
+};
+
+template<>
+struct RpcParamTraits<int>
+{
+  static bool bind(cJSON const* json, int& value, RpcParamPath const& path, std::string& error)
+  {
+    if (!cJSON_IsNumber(json))
+    {
+      rpc_params_detail::typeError(path, "an integer", error);
+      return false;
+    }
+    value = json->valueint;
+    return true;
+  }
+  static cJSON* schema()
+    { return rpc_params_detail::typeSchema("integer"); }
+};
+
+template<>
+struct RpcParamTraits<double>
+{
+  static bool bind(cJSON const* json, double& value, RpcParamPath const& path, std::string& error)
+  {
+    if (!cJSON_IsNumber(json))
+    {
+      rpc_params_detail::typeError(path, "a number", error);
+      return false;
+    }
+    value = json->valuedouble;
+    return true;
+  }
+  static cJSON* schema()
+    { return rpc_params_detail::typeSchema("number"); }
+};
+
+template<>
+struct RpcParamTraits<bool>
+{
+  static bool bind(cJSON const* json, bool& value, RpcParamPath const& path, std::string& error)
+  {
+    if (!cJSON_IsBool(json))
+    {
+      rpc_params_detail::typeError(path, "a boolean", error);
+      return false;
+    }
+    value = cJSON_IsTrue(json);
+    return true;
+  }
+  static cJSON* schema()
+    { return rpc_params_detail::typeSchema("boolean"); }
+};
+
+template<>
+struct RpcParamTraits<cJSON const*>
+{
+  static bool bind(cJSON const* json, cJSON const*& value, RpcParamPath const& UNUSED_PARAM(path),
+    std::string& UNUSED_PARAM(error))
+  {
+    value = json;
+    return true;
+  }
+  static cJSON* schema()
+    { return rpc_params_detail::typeSchema(nullptr); }
+};
+
+template<class P>
+class RpcParams
+{
+public:
+  // bind tracks the fields it has seen in a 64 bit mask
+  static size_t const kMaxFields = 64;
+
+  // describes the member called name. Fields that aren't required keep
+  // whatever value P was initialized with when they're missing. Throws
+  // std::runtime_error past kMaxFields
+  template<class T>
+  RpcParams& field(char const* name, T P::* member, bool required = true,
+    char const* description = nullptr)
+  {
+    if (m_fields.size() == kMaxFields)
+      throw std::runtime_error(std::string("too many params, ") + name + " is past the limit of 64");
+
+    m_fields.push_back(std::shared_ptr<FieldBase const>(
+      new Field<T>(name, member, required, description)));
+    return *this;
+  }
+
+  // binds json, which may be null when the request has no params, onto
+  // value. On failure error names the first bad field
+  bool bind(cJSON const* json, P& value, RpcParamPath const& path, std::string& error) const
+  {
+    if (json && !cJSON_IsObject(json))
+    {
+      rpc_params_detail::typeError(path, "an object", error);
+      return false;
+    }
+
+    // one bit per field, field() keeps them within kMaxFields
+    uint64_t seen = 0;
+    for (cJSON const* item = json ? json->child : nullptr; item; item = item->next)
+    {
+      if (!item->string)
+        continue;
+
+      for (size_t i = 0; i < m_fields.size(); ++i)
+      {
+        FieldBase const& f = *m_fields[i];
+        if (f.Name.empty() || tolower(f.Name[0]) != tolower(item->string[0]))
+          continue;
+        if (strcasecmp(f.Name.c_str(), item->string) != 0)
+          continue;
+
+        uint64_t const bit = uint64_t(1) << i;
+        if ((seen & bit) == 0)
+        {
+          seen |= bit;
+          if (!f.bind(item, value, path, error))
+            return false;
+        }
+        break;
+      }
+    }
+
+    for (size_t i = 0; i < m_fields.size(); ++i)
+    {
+      FieldBase const& f = *m_fields[i];
+      if (f.Required && (seen & (uint64_t(1) << i)) == 0)
+      {
+        error = RpcParamPath { f.Name.c_str(), &path }.toString();
+        error += " is required";
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  // JSON Schema style description of the object
+  cJSON* schema() const
+  {
+    cJSON* schema = rpc_params_detail::typeSchema("object");
+    cJSON* properties = cJSON_CreateObject();
+    cJSON* required = cJSON_CreateArray();
+    for (auto const& f : m_fields)
+    {
+      cJSON* property = f->schema();
+      if (!f->Description.empty())
+        cJSON_AddItemToObject(property, "description", cJSON_CreateString(f->Description.c_str()));
+      cJSON_AddItemToObject(properties, f->Name.c_str(), property);
+      if (f->Required)
+        cJSON_AddItemToArray(required, cJSON_CreateString(f->Name.c_str()));
+    }
+    cJSON_AddItemToObject(schema, "properties", properties);
+    cJSON_AddItemToObject(schema, "required", required);
+    return schema;
+  }
+
+private:
+  struct FieldBase
+  {
+    FieldBase(char const* name, bool required, char const* description)
+      : Name(name)
+      , Required(required)
+      , Description(description ? description : "") { }
+    virtual ~FieldBase() { }
+    virtual bool bind(cJSON const* json, P& value, RpcParamPath const& path,
+      std::string& error) const = 0;
+    virtual cJSON* schema() const = 0;
+
+    std::string const Name;
+    bool const        Required;
+    std::string const Description;
+  };
+
+  template<class T>
+  struct Field : public FieldBase
+  {
+    Field(char const* name, T P::* member, bool required, char const* description)
+      : FieldBase(name, required, description)
+      , Member(member) { }
+
+    virtual bool bind(cJSON const* json, P& value, RpcParamPath const& path,
+      std::string& error) const override
+    {
+      RpcParamPath const inner { this->Name.c_str(), &path };
+      return RpcParamTraits<T>::bind(json, value.*Member, inner, error);
+    }
+
+    virtual cJSON* schema() const override
+      { return RpcParamTraits<T>::schema(); }
+
+    T P::* const Member;
+  };
+
+  std::vector< std::shared_ptr<FieldBase const> > m_fields;
+};
+
+#endif
@@ -17,14 +17,20 @@
 #include "rpcserver.h"
 #include "rpclogger.h"
 #include "jsonrpc.h"
+#include "jsonwriter.h"
+#include "rpcstream.h"
 
+#include <algorithm>
+#include <iterator>
 #include <sstream>
 
 
 #ifdef WITH_BLUEZ
 #include "bluez/gattServer.h"
 #endif
+#include "socket/socketServer.h"
 
+#include <errno.h>
 #include <string.h>
 #include <stdarg.h>
 #include <sys/stat.h>
@@ -51,7 +57,104 @@ namespace
     return stat(s, &buf) == 0;
   }
 
-  std::map< std::string, RpcServiceConstructor > serviceConstructors;
+  // services register themselves from static initializers in other
+  // translation units, so the map has to be constructed on first use
+  std::map< std::string, RpcServiceConstructor >& serviceConstructors()
+  {
+    static std::map< std::string, RpcServiceConstructor > constructors;
+    return constructors;
+  }
+
+  int const kNoSession = -1;
+  int const kDefaultWorkerThreads = 4;
+
+  // session of the request being dispatched on this thread. Messages a
+  // service sends while handling a request go back to the client that sent
+  // it, anything sent outside of a request goes to every client.
+  thread_local int currentSessionId = kNoSession;
+
+  // responses are serialized into a buffer sized from the last one written
+  // on the same thread, which is usually close enough to avoid regrowing
+  size_t const kMinSendReserve = 256;
+  thread_local size_t lastSendSize = 0;
+
+  // streamed responses go out in parts of about kStreamChunkSize, and the
+  // writer waits while more than kStreamHighWater bytes are queued for the
+  // client. A client that doesn't drain that far within kStreamTimeout is
+  // taken to have gone away
+  size_t const kStreamChunkSize = 2048;
+  size_t const kStreamHighWater = 4 * kStreamChunkSize;
+  std::chrono::milliseconds const kStreamTimeout(10000);
+
+  // set while a batch member is dispatched on this thread, its response
+  // has to be collected rather than streamed
+  thread_local bool currentIsBatchMember = false;
+
+  // set once the method being dispatched on this thread has streamed its
+  // own response
+  thread_local bool responseStreamed = false;
+}
+
+void
+RpcConnectedClient::beginRecord()
+{
+  m_record_mutex.lock();
+}
+
+void
+RpcConnectedClient::appendToRecord(std::vector<char>&& part)
+{
+  enqueuePartial(std::move(part), false);
+}
+
+void
+RpcConnectedClient::endRecord(std::vector<char>&& part)
+{
+  enqueuePartial(std::move(part), true);
+  m_record_mutex.unlock();
+}
+
+bool
+RpcConnectedClient::waitForSendSpace(size_t UNUSED_PARAM(limit),
+  std::chrono::milliseconds UNUSED_PARAM(timeout))
+{
+  return true;
+}
+
+void
+RpcConnectedClient::enqueuePartial(std::vector<char>&& part, bool last)
+{
+  if (m_partial_record.empty())
+    m_partial_record = std::move(part);
+  else
+    m_partial_record.insert(m_partial_record.end(), part.begin(), part.end());
+
+  if (last)
+  {
+    std::vector<char> record;
+    record.swap(m_partial_record);
+    enqueueForSend(std::move(record));
+  }
+}
+
+RpcServer::RpcBatch::RpcBatch(int sessionId, cJSON* req, std::unique_ptr<JsonArena>&& arena)
+  : SessionId(sessionId)
+  , Arena(std::move(arena))
+  , MemberArenas(cJSON_GetArraySize(req))
+  , Request(req)
+  , Responses(cJSON_GetArraySize(req), nullptr)
+  , Pending(cJSON_GetArraySize(req))
+{
+}
+
+RpcServer::RpcBatch::~RpcBatch()
+{
+  for (cJSON* res : Responses)
+  {
+    if (res)
+      cJSON_Delete(res);
+  }
+  cJSON_Delete(Request);
 }
 
 std::string
@@ -80,21 +183,35 @@ RpcServer::RpcMethodInfo::parseMethod(char const* s)
 }
 
 std::shared_ptr<RpcListener>
-RpcListener::create()
+RpcListener::create(cJSON const* conf)
 {
-  return std::shared_ptr<RpcListener>(
+  std::shared_ptr<RpcListener> listener;
+
+  char const* name = JsonRpc::getString(conf, "name", false, "ble");
+  if (strcmp(name, "unix") == 0 || strcmp(name, "tcp") == 0)
+  {
+    listener.reset(new SocketServer());
+  }
 #ifdef WITH_BLUEZ
-    new GattServer()
+  else if (strcmp(name, "ble") == 0)
+  {
+    listener.reset(new GattServer());
+  }
 #endif
-  );
+  else
+  {
+    XLOG_ERROR("unsupported listener:%s", name);
+  }
+
+  return listener;
 }
 
 RpcService*
 RpcService::createServiceByName(std::string const& name)
 {
   RpcService* service = nullptr;
-  auto itr = serviceConstructors.find(name);
-  if (itr != serviceConstructors.end())
+  auto itr = serviceConstructors().find(name);
+  if (itr != serviceConstructors().end())
     service = itr->second();
   return service;
 }
@@ -107,7 +224,7 @@ RpcServiceRegistrar::RpcServiceRegistrar(std::string const& name, RpcServiceCons
 void
 RpcService::registerServiceConstructor(std::string const& name, RpcServiceConstructor const& ctor)
 {
-  serviceConstructors.insert(std::make_pair(name, ctor));
+  serviceConstructors().insert(std::make_pair(name, ctor));
 }
 
 RpcService::RpcService()
@@ -118,6 +235,29 @@ RpcService::~RpcService()
 {
 }
 
+std::vector<RpcMethodEntry>
+RpcService::methods()
+{
+  std::vector<RpcMethodEntry> entries;
+  for (std::string const& name : methodNames())
+  {
+    RpcMethod method = [this, name](cJSON const* req) -> cJSON* { return this->invokeMethod(name, req); };
+    entries.push_back(RpcMethodEntry { name, method, concurrency(name), nullptr });
+  }
+  return entries;
+}
+
+cJSON*
+RpcService::paramsSchema(std::string const& UNUSED_PARAM(name)) const
+{
+  return nullptr;
+}
+
+void
+RpcService::setResponseStreamFactory(RpcResponseStreamFactory const& UNUSED_PARAM(factory))
+{
+}
+
 BasicRpcService::BasicRpcService(std::string const& name)
   : RpcService()
   , m_config(nullptr)
@@ -147,9 +287,76 @@ BasicRpcService::methodNames() const
 }
 
 void
-BasicRpcService::registerMethod(std::string const& name, RpcMethod const& method)
+BasicRpcService::registerMethod(std::string const& name, RpcMethod const& method,
+  RpcConcurrency concurrency)
 {
   m_methods.insert(std::make_pair(name, method));
+  m_concurrency.insert(std::make_pair(name, concurrency));
+}
+
+void
+BasicRpcService::setStrand(std::string const& name, RpcStrandFunction const& strand)
+{
+  m_strands[name] = strand;
+}
+
+std::vector<RpcMethodEntry>
+BasicRpcService::methods()
+{
+  std::vector<RpcMethodEntry> entries;
+  entries.reserve(m_methods.size());
+  for (auto const& kv : m_methods)
+  {
+    auto strand = m_strands.find(kv.first);
+    entries.push_back(RpcMethodEntry { kv.first, kv.second, concurrency(kv.first),
+      strand != m_strands.end() ? strand->second : nullptr });
+  }
+  return entries;
+}
+
+cJSON*
+BasicRpcService::paramsSchema(std::string const& name) const
+{
+  auto itr = m_schemas.find(name);
+  if (itr == m_schemas.end())
+    return nullptr;
+  return itr->second();
+}
+
+void
+BasicRpcService::setResponseStreamFactory(RpcResponseStreamFactory const& factory)
+{
+  m_open_stream = factory;
+}
+
+std::unique_ptr<RpcResponseStream>
+BasicRpcService::openResponseStream(cJSON const* req)
+{
+  if (m_open_stream)
+    return m_open_stream(req);
+  return std::unique_ptr<RpcResponseStream>(new RpcResponseStream());
+}
+
+cJSON const*
+BasicRpcService::paramsOf(cJSON const* req)
+{
+  return cJSON_GetObjectItem(req, "params");
+}
+
+cJSON*
+BasicRpcService::invalidParams(std::string const& error)
+{
+  XLOG_INFO("invalid params:%s", error.c_str());
+  return JsonRpc::makeError(kJsonRpcInvalidParams, "%s", error.c_str());
+}
+
+RpcConcurrency
+BasicRpcService::concurrency(std::string const& name) const
+{
+  auto itr = m_concurrency.find(name);
+  if (itr == m_concurrency.end())
+    return RpcConcurrency::Parallel;
+  return itr->second;
 }
 
 void
@@ -171,6 +378,14 @@ BasicRpcService::notifyAndDelete(cJSON* json)
   cJSON_Delete(json);
 }
 
+void
+BasicRpcService::notifyProgress(int requestId, cJSON* result)
+{
+  cJSON* res = JsonRpc::wrapResponse(0, result, requestId);
+  cJSON_AddBoolToObject(res, "progress", true);
+  notifyAndDelete(res);
+}
+
 cJSON*
 BasicRpcService::invokeMethod(std::string const& name, cJSON const* req)
 {
@@ -203,9 +418,14 @@ BasicRpcService::invokeMethod(std::string const& name, cJSON const* req)
 }
 
 RpcServer::RpcServer(std::string const& configFile, cJSON const* config)
-  : m_config_file(configFile)
-  , m_running(false)
+  : m_clients(std::make_shared<RpcClientMap>())
+  , m_next_session_id(1)
+  , m_config_file(configFile)
+  , m_running(true)
+  , m_use_arena(true)
 {
+  sem_init(&m_work_available, 0, 0);
+
   if (config)
     m_config = cJSON_Duplicate(config, true);
   else
@@ -232,7 +452,27 @@ RpcServer::RpcServer(std::string const& configFile, cJSON const* config)
     }
   }
 
-  m_dispatch_thread.reset(new std::thread([this] { this->processIncomingQueue(); }));
+  cJSON const* useArena = JsonRpc::search(m_config, "/server/json-arena", false);
+  if (useArena && cJSON_IsFalse(useArena))
+    m_use_arena = false;
+  XLOG_INFO("per-request json arena %s", m_use_arena ? "enabled" : "disabled");
+
+  buildDispatchTable();
+
+  int workerThreads = JsonRpc::getInt(m_config, "/server/worker-threads", false,
+    kDefaultWorkerThreads);
+  if (workerThreads < 1)
+  {
+    XLOG_WARN("invalid worker-threads:%d, using 1", workerThreads);
+    workerThreads = 1;
+  }
+
+  XLOG_INFO("starting %d worker threads", workerThreads);
+  for (int i = 0; i < workerThreads; ++i)
+  {
+    std::shared_ptr<std::thread> worker(new std::thread([this] { this->processIncomingQueue(); }));
+    m_workers.push_back(worker);
+  }
 }
 
 RpcServer::~RpcServer()
@@ -240,33 +480,108 @@ RpcServer::~RpcServer()
   if (m_config)
     cJSON_Delete(m_config);
 
+  m_running = false;
+  for (size_t i = 0; i < m_workers.size(); ++i)
+    sem_post(&m_work_available);
+  for (auto const& worker : m_workers)
+    worker->join();
+
+  drainIntake();
+  for (RpcIncomingRequest const& incoming : m_incoming_queue)
   {
-    std::lock_guard<std::mutex> lock(m_mutex);
-    m_running = false;
+    if (!incoming.Batch)
+      cJSON_Delete(incoming.Request);
   }
-  m_cond.notify_one();
-  m_dispatch_thread->join();
+  m_incoming_queue.clear();
+
+  sem_destroy(&m_work_available);
+}
+
+int
+RpcServer::addClient(std::shared_ptr<RpcConnectedClient> const& client)
+{
+  std::lock_guard<std::mutex> guard(m_clients_mutex);
+
+  int sessionId = m_next_session_id++;
+  client->setDataHandler([this, sessionId](char const* buff, int n)
+  {
+    this->onIncomingMessage(sessionId, buff, n);
+  });
+
+  std::shared_ptr<RpcClientMap> clients(new RpcClientMap(*m_clients));
+  clients->insert(std::make_pair(sessionId, client));
+  std::atomic_store(&m_clients, std::shared_ptr<RpcClientMap const>(clients));
+
+  XLOG_INFO("new session:%d, %zu active", sessionId, clients->size());
+  return sessionId;
 }
 
 void
-RpcServer::setClient(std::shared_ptr<RpcConnectedClient> const& client)
+RpcServer::removeClient(std::shared_ptr<RpcConnectedClient> const& client)
 {
-  std::lock_guard<std::mutex> guard(m_mutex);
-  m_client = client;
+  std::lock_guard<std::mutex> guard(m_clients_mutex);
+
+  std::shared_ptr<RpcClientMap> clients(new RpcClientMap(*m_clients));
+  for (auto itr = clients->begin(); itr != clients->end(); ++itr)
+  {
+    if (itr->second == client)
+    {
+      XLOG_INFO("closing session:%d", itr->first);
+      clients->erase(itr);
+      break;
+    }
+  }
+
+  // a sender that loaded the old snapshot can still hold the client for the
+  // duration of its send, transports shouldn't assume they drop the last
+  // reference
+  std::atomic_store(&m_clients, std::shared_ptr<RpcClientMap const>(clients));
 }
 
 void
-RpcServer::stop()
+RpcServer::sendToSession(int sessionId, std::vector<char>&& record)
 {
-  std::lock_guard<std::mutex> guard(m_mutex);
-  m_client.reset();
+  std::shared_ptr<RpcClientMap const> clients = std::atomic_load(&m_clients);
+  if (sessionId == kNoSession)
+  {
+    // every client but the last gets its own copy, the last one takes the
+    // original buffer
+    for (auto itr = clients->begin(); itr != clients->end(); ++itr)
+    {
+      if (std::next(itr) == clients->end())
+      {
+        itr->second->enqueueForSend(std::move(record));
+      }
+      else
+      {
+        std::vector<char> copy;
+        copy.reserve(record.size() + 1);
+        copy.insert(copy.end(), record.begin(), record.end());
+        itr->second->enqueueForSend(std::move(copy));
+      }
+    }
+  }
+  else
+  {
+    auto itr = clients->find(sessionId);
+    if (itr != clients->end())
+      itr->second->enqueueForSend(std::move(record));
+    else
+      XLOG_INFO("session:%d closed, dropping %zu bytes", sessionId, record.size());
+  }
 }
 
 void
-RpcServer::run()
+RpcServer::sendJson(int sessionId, cJSON const* json)
 {
-  m_client->run();
-  stop();
+  // compact output written straight into the buffer the transport queues.
+  // the extra byte leaves room for the record delimiter
+  std::vector<char> record;
+  record.reserve(std::max(lastSendSize, kMinSendReserve) + 1);
+  JsonWriter::write(json, record);
+  lastSendSize = record.size();
+
+  sendToSession(sessionId, std::move(record));
 }
 
 void
@@ -275,33 +590,69 @@ RpcServer::enqueueAsyncMessage(cJSON const* json)
   if (!json)
     return;
 
-  char* s = cJSON_PrintUnformatted(json);
-  int n = static_cast<int>(strlen(s));
-
-  XLOG_INFO("notify:%s", s);
+  XLOG_DEBUG("notify");
+  XLOG_JSON(RpcLogLevel::Debug, json);
 
-  {
-    std::lock_guard<std::mutex> guard(m_mutex);
-    if (m_client)
-      m_client->enqueueForSend(s, n);
-    free(s);
-  }
+  sendJson(currentSessionId, json);
 }
 
 void
-RpcServer::onIncomingMessage(char const* s, int UNUSED_PARAM(n))
+RpcServer::onIncomingMessage(int sessionId, char const* s, int UNUSED_PARAM(n))
 {
   if (!s || strlen(s) == 0)
     return;
 
-  XLOG_INFO("enqueue new incoming request");
-  std::lock_guard<std::mutex> guard(m_mutex);
+  XLOG_INFO("enqueue new incoming request for session:%d", sessionId);
+
+  // parsing happens on the transport's thread without holding any lock. The
+  // request tree goes into the arena that travels with it to the worker
+  std::unique_ptr<JsonArena> arena(m_use_arena ? new JsonArena() : nullptr);
+  cJSON* req = nullptr;
+  {
+    JsonArena::Scope arenaScope(arena.get());
+    req = cJSON_Parse(s);
+  }
+
+  if (req && cJSON_IsArray(req))
+  {
+    int n = cJSON_GetArraySize(req);
+    if (n == 0)
+    {
+      cJSON_Delete(req);
+
+      cJSON* res = JsonRpc::wrapResponse(-1, JsonRpc::makeError(kJsonRpcInvalidRequest,
+        "empty batch"), -1);
+      sendResponse(sessionId, res);
+      cJSON_Delete(res);
+      return;
+    }
 
-  cJSON* req = cJSON_Parse(s);
-  if (req)
+    // members are scheduled like any other request so parallel methods in a
+    // batch run side by side and serialized ones keep their order
+    std::shared_ptr<RpcBatch> batch(new RpcBatch(sessionId, req, std::move(arena)));
+    for (int i = 0; i < n; ++i)
+    {
+      if (m_use_arena)
+        batch->MemberArenas[i].reset(new JsonArena());
+
+      RpcIncomingRequest incoming;
+      incoming.SessionId = sessionId;
+      incoming.Request = cJSON_GetArrayItem(req, i);
+      incoming.Strand = strandOf(incoming.Request);
+      incoming.Batch = batch;
+      incoming.BatchIndex = i;
+      enqueueRequest(std::move(incoming));
+    }
+    XLOG_INFO("session:%d sent batch of %d requests", sessionId, n);
+  }
+  else if (req)
   {
-    m_incoming_queue.push(req);
-    m_cond.notify_all();
+    RpcIncomingRequest incoming;
+    incoming.SessionId = sessionId;
+    incoming.Request = req;
+    incoming.Strand = strandOf(req);
+    incoming.Arena = std::move(arena);
+    enqueueRequest(std::move(incoming));
   }
   else
   {
@@ -310,101 +661,271 @@ RpcServer::onIncomingMessage(char const* s, int UNUSED_PARAM(n))
   }
 }
 
+void
+RpcServer::enqueueRequest(RpcIncomingRequest&& incoming)
+{
+  m_intake.push(std::move(incoming));
+  sem_post(&m_work_available);
+}
+
+std::string
+RpcServer::strandOf(cJSON const* req) const
+{
+  // anything that isn't a well formed call to a serialized method only
+  // produces an error, so it doesn't need ordering
+  cJSON const* method = cJSON_GetObjectItem(req, "method");
+  if (!method || !method->valuestring || !JsonRpc::getString(req, "jsonrpc", false, nullptr))
+    return std::string();
+
+  RpcDispatchEntry const* entry = m_dispatch.find(method->valuestring);
+  if (!entry)
+    return std::string();
+  if (entry->Concurrency == RpcConcurrency::Serialized)
+    return entry->ServiceName;
+
+  // prefixed so a service's keys can't collide with another's, or with a
+  // service's own strand
+  if (entry->Strand)
+  {
+    std::string key = entry->Strand(req);
+    if (!key.empty())
+      return entry->ServiceName + "/" + key;
+  }
+
+  return std::string();
+}
+
+void
+RpcServer::drainIntake()
+{
+  // m_schedule_mutex must be held, it makes the caller the intake's only
+  // consumer
+  RpcIncomingRequest incoming;
+  while (m_intake.pop(incoming))
+    m_incoming_queue.push_back(std::move(incoming));
+}
+
+bool
+RpcServer::nextRunnableRequest(RpcIncomingRequest& incoming)
+{
+  // m_schedule_mutex must be held. Takes the oldest request whose strand
+  // isn't already running on another worker. Skipping over a busy strand
+  // keeps its requests in arrival order since the next one is always the
+  // oldest.
+  for (auto itr = m_incoming_queue.begin(); itr != m_incoming_queue.end(); ++itr)
+  {
+    if (!itr->Strand.empty() && m_busy_strands.count(itr->Strand))
+      continue;
+
+    incoming = std::move(*itr);
+    m_incoming_queue.erase(itr);
+
+    if (!incoming.Strand.empty())
+      m_busy_strands.insert(incoming.Strand);
+    return true;
+  }
+  return false;
+}
+
+bool
+RpcServer::hasRunnableRequest() const
+{
+  // m_schedule_mutex must be held
+  for (RpcIncomingRequest const& incoming : m_incoming_queue)
+  {
+    if (incoming.Strand.empty() || !m_busy_strands.count(incoming.Strand))
+      return true;
+  }
+  return false;
+}
+
 void
 RpcServer::processIncomingQueue()
 {
-  m_running = true;
+  // m_work_available is only a wakeup hint. Each push posts once, and a
+  // worker that takes a request passes the hint on when there's more to run,
+  // so a post that finds nothing (a push that isn't linked yet, or a busy
+  // strand) is made up for by a later one.
   while (true)
   {
-    cJSON* req = nullptr;
-    XLOG_INFO("processing incoming queue");
+    while (sem_wait(&m_work_available) == -1 && errno == EINTR)
+      ;
 
+    if (!m_running)
     {
-      std::unique_lock<std::mutex> guard(m_mutex);
-      m_cond.wait(guard, [this] { return !this->m_incoming_queue.empty() || !this->m_running; });
+      XLOG_INFO("worker thread got shutdown signal");
+      return;
+    }
 
-      if (!m_running)
+    while (m_running)
+    {
+      RpcIncomingRequest incoming;
+      bool moreWork = false;
       {
-        XLOG_INFO("worker thread got shutdown signal");
-        return;
+        std::lock_guard<std::mutex> guard(m_schedule_mutex);
+        drainIntake();
+        if (!nextRunnableRequest(incoming))
+          break;
+        moreWork = hasRunnableRequest();
       }
 
-      if (!m_incoming_queue.empty())
+      if (moreWork)
+        sem_post(&m_work_available);
+
+      XLOG_INFO("processing request for session:%d", incoming.SessionId);
+      currentSessionId = incoming.SessionId;
+      if (incoming.Batch)
       {
-        req = m_incoming_queue.front();
-        m_incoming_queue.pop();
+        JsonArena::Scope arenaScope(incoming.Batch->MemberArenas[incoming.BatchIndex].get());
+        currentIsBatchMember = true;
+        processBatchMember(incoming);
+        currentIsBatchMember = false;
       }
-    }
+      else
+      {
+        JsonArena::Scope arenaScope(incoming.Arena.get());
+        JsonDeleter requestDeleter(incoming.Request);
+        processRequest(incoming.SessionId, incoming.Request);
+      }
+      currentSessionId = kNoSession;
 
-    if (req)
-    {
-      JsonDeleter requestDeleter(req);
-      processRequest(req);
+      // the response is already queued with the transport, everything the
+      // request allocated goes back in one go
+      incoming.Arena.reset();
+      incoming.Batch.reset();
+
+      // a request for this strand may have been passed over while it was
+      // busy, going around the loop picks it up and wakes another worker if
+      // there's more
+      if (!incoming.Strand.empty())
+      {
+        std::lock_guard<std::mutex> guard(m_schedule_mutex);
+        m_busy_strands.erase(incoming.Strand);
+      }
     }
   }
 }
 
 cJSON*
-RpcServer::invokeMethod(RpcMethodInfo const& methodInfo, cJSON const* req)
+RpcServer::invokeMethod(char const* name, cJSON const* req)
 {
-  cJSON* res = nullptr;
+  RpcDispatchEntry const* entry = m_dispatch.find(name);
+  if (!entry)
+    return methodNotFound(name);
+
+  XLOG_INFO("invoke method:%s", name);
+
+  cJSON* res = entry->Method(req);
+  if (!res && !responseStreamed)
+    res = JsonRpc::makeError(-1, "%s returned null?", name);
 
-  auto service = m_services.find(methodInfo.ServiceName);
-  if (service == m_services.end())
+  return res;
+}
+
+cJSON*
+RpcServer::methodNotFound(char const* name) const
+{
+  // only the error path pays for splitting the name
+  RpcMethodInfo methodInfo = RpcMethodInfo::parseMethod(name ? name : "");
+  if (m_services.find(methodInfo.ServiceName) == m_services.end())
+    return JsonRpc::makeError(ENOENT, "service %s not found", methodInfo.ServiceName.c_str());
+
+  XLOG_WARN("method %s not found", name);
+  return JsonRpc::makeError(-1, "method %s not found", name);
+}
+
+std::unique_ptr<RpcResponseStream>
+RpcServer::openResponseStream(cJSON const* req)
+{
+  std::shared_ptr<RpcConnectedClient> client;
+  if (currentSessionId != kNoSession && !currentIsBatchMember)
   {
-    res = JsonRpc::makeError(ENOENT, "service %s not found",
-      methodInfo.ServiceName.c_str());
+    std::shared_ptr<RpcClientMap const> clients = std::atomic_load(&m_clients);
+    auto itr = clients->find(currentSessionId);
+    if (itr != clients->end())
+      client = itr->second;
   }
+
+  if (!client)
+    return std::unique_ptr<RpcResponseStream>(new RpcResponseStream());
+
+  return std::unique_ptr<RpcResponseStream>(new RpcResponseStream(client,
+    JsonRpc::getInt(req, "id", false, -1), kStreamChunkSize, kStreamHighWater, kStreamTimeout,
+    [] { responseStreamed = true; }));
+}
+
+void
+RpcServer::processRequest(int sessionId, cJSON const* req)
+{
+  cJSON* res = createResponse(req);
+
+  // a method that streamed its result has already sent the response
+  if (responseStreamed)
+    responseStreamed = false;
   else
+    sendResponse(sessionId, res);
+
+  if (res)
+    cJSON_Delete(res);
+}
+
+void
+RpcServer::processBatchMember(RpcIncomingRequest const& incoming)
+{
+  std::shared_ptr<RpcBatch> const& batch = incoming.Batch;
+  batch->Responses[incoming.BatchIndex] = createResponse(incoming.Request);
+
+  // the acquire half makes every other member's response visible to
+  // whichever worker finishes last
+  if (batch->Pending.fetch_sub(1, std::memory_order_acq_rel) != 1)
+    return;
+
+  cJSON* res = cJSON_CreateArray();
+  for (cJSON*& member : batch->Responses)
   {
-    res = service->second->invokeMethod(methodInfo.MethodName, req);
-    if (!res)
-      res = JsonRpc::makeError(-1, "%s.%s returned null?",
-        methodInfo.ServiceName.c_str(),
-        methodInfo.MethodName.c_str());
+    if (!member)
+      continue;
+    cJSON_AddItemToArray(res, member);
+    member = nullptr;
   }
 
-  return res;
+  // a batch of nothing but notifications gets no reply at all
+  if (res->child)
+    sendResponse(batch->SessionId, res);
+  cJSON_Delete(res);
 }
 
-void
-RpcServer::processRequest(cJSON const* req)
+cJSON*
+RpcServer::createResponse(cJSON const* req)
 {
   cJSON* res = nullptr;
 
   XLOG_INFO("processing new incoming request");
-  {
-    char* s = cJSON_Print(req);
-    if (s)
-    {
-      XLOG_INFO("req:%s", s);
-      free(s);
-    }
-  }
+  XLOG_JSON(RpcLogLevel::Debug, req);
 
   // ensure json-rpc request
-  if (!JsonRpc::getString(req, "jsonrpc", false, nullptr))
+  if (!cJSON_IsObject(req))
+    res = JsonRpc::wrapResponse(-1, JsonRpc::makeError(kJsonRpcInvalidRequest,
+      "request must be an object"), -1);
+  else if (!JsonRpc::getString(req, "jsonrpc", false, nullptr))
     res = processNonJsonRpcRequest(req);
   else
     res = processJsonRpcRequest(req);
 
-  char* s = cJSON_Print(res);
-  if (s)
-  {
-    XLOG_INFO("res:%s", s);
-    {
-      std::lock_guard<std::mutex> guard(m_mutex);
-      if (m_client)
-        m_client->enqueueForSend(s, strlen(s));
-    }
-    free(s);
-  }
-  else
+  return res;
+}
+
+void
+RpcServer::sendResponse(int sessionId, cJSON const* res)
+{
+  if (!res)
   {
-    XLOG_ERROR("failed to serialize JSON response to string");
+    XLOG_ERROR("no response to send to session:%d", sessionId);
+    return;
   }
 
-  cJSON_Delete(res);
+  XLOG_JSON(RpcLogLevel::Debug, res);
+  sendJson(sessionId, res);
 }
 
 cJSON*
@@ -445,8 +966,12 @@ RpcServer::processJsonRpcRequest(cJSON const* req)
     res = JsonRpc::makeError(-1, "request doesn't contain a 'method'");
   }
 
+  // a batch member without an id is a notification. It's run like any other
+  // request but gets no response, and its slot is left out of the batch's
+  bool notification = !res && currentIsBatchMember && !cJSON_GetObjectItem(req, "id");
+
   int requestId = -1;
-  if (!res)
+  if (!res && !notification)
   {
     cJSON* id = cJSON_GetObjectItem(req, "id");
     if (!id)
@@ -464,7 +989,7 @@ RpcServer::processJsonRpcRequest(cJSON const* req)
   {
     try
     {
-      res = invokeMethod(RpcMethodInfo::parseMethod(method->valuestring), req);
+      res = invokeMethod(method->valuestring, req);
     }
     catch (std::exception const& err)
     {
@@ -472,6 +997,13 @@ RpcServer::processJsonRpcRequest(cJSON const* req)
     }
   }
 
+  if (responseStreamed || notification)
+  {
+    if (res)
+      cJSON_Delete(res);
+    return nullptr;
+  }
+
   // if function returned { "code": 1234, ... } where code != 0, then
   // it's an error, else it was ok. This is handled by the wrapResponse
   int code = JsonRpc::getInt(res, "code", false, 0);
@@ -485,27 +1017,12 @@ RpcServer::registerService(std::shared_ptr<RpcService> const& service)
   RpcNotificationFunction callback = std::bind(&RpcServer::enqueueAsyncMessage, this,
     std::placeholders::_1);
   m_services.insert(std::make_pair(service->name(), service));
+  service->setResponseStreamFactory(std::bind(&RpcServer::openResponseStream, this,
+    std::placeholders::_1));
 
-  // TODO: someone update JsonRpc::search to handle lists so we can do
-  // cJSON* conf = JsonRpc::search(m_conf, "/services/name/[@name='wifi']");
-  cJSON* conf = nullptr;
-  cJSON* serviceConfig = nullptr;
+  cJSON const* conf = nullptr;
   if (m_config)
-    serviceConfig = cJSON_GetObjectItem(m_config, "services");
-  
-  if (serviceConfig)
-  {
-    for (int i = 0, n = cJSON_GetArraySize(serviceConfig); i < n; ++i)
-    {
-      cJSON* temp = cJSON_GetArrayItem(serviceConfig, i);
-      cJSON* name = cJSON_GetObjectItem(temp, "name");
-      if (name && strcmp(name->valuestring, service->name().c_str()) == 0)
-      {
-        conf = temp;
-        break;
-      }
-    }
-  }
+    conf = JsonRpc::search(m_config, JsonPath("/services[@name='" + service->name() + "']"), false);
 
   if (conf == nullptr)
     XLOG_WARN("service %s is missing configuration", service->name().c_str());
@@ -513,6 +1030,25 @@ RpcServer::registerService(std::shared_ptr<RpcService> const& service)
   service->init(conf, callback);
 }
 
+void
+RpcServer::buildDispatchTable()
+{
+  std::vector< std::pair<std::string, RpcDispatchEntry> > entries;
+  for (auto const& kv : m_services)
+  {
+    for (RpcMethodEntry& method : kv.second->methods())
+    {
+      RpcMethodInfo methodInfo(kv.first, method.Name);
+      entries.push_back(std::make_pair(methodInfo.toString(),
+        RpcDispatchEntry { kv.first, std::move(method.Method), method.Concurrency,
+          std::move(method.Strand) }));
+    }
+  }
+
+  m_dispatch.build(std::move(entries));
+  XLOG_INFO("dispatch table has %zu methods", m_dispatch.size());
+}
+
 RpcServer::RpcSystemService::RpcSystemService(RpcServer* parent)
   : BasicRpcService("rpc")
   , m_server(parent)
@@ -530,12 +1066,24 @@ RpcServer::RpcSystemService::init(cJSON const* UNUSED_PARAM(config),
   // openssl genpkey -algorithm Ec -pkeyopt ec_paramgen_curve:P-256 -pkeyopt ec_param_enc:named_curve > /tmp/bootstrap_private.pem
   // openssl pkey -pubout -in /tmp/bootstrap_private.pem > /tmp/bootstrap_public.pem
 
-  registerMethod("list-services", [this](cJSON const* req) -> cJSON* { return this->listServices(req); });
-  registerMethod("list-methods", [this](cJSON const* req) -> cJSON* { return this->listMethods(req); });
+  registerMethod("list-services", [this](cJSON const* req) -> cJSON* { return this->listServices(req); },
+    RpcConcurrency::Parallel);
+  registerMethod<ListMethodsParams>("list-methods",
+    [this](ListMethodsParams const& params, cJSON const* UNUSED_PARAM(req)) -> cJSON*
+      { return this->listMethods(params); },
+    RpcConcurrency::Parallel);
   registerMethod("get-server-pubkey", [this](cJSON const* req) -> cJSON* { return this->getServerPublicKey(req); });
   registerMethod("set-client-pubkey", [this](cJSON const* req) -> cJSON* { return this->setClientPublicKey(req); });
 }
 
+RpcParams<RpcServer::RpcSystemService::ListMethodsParams> const&
+RpcServer::RpcSystemService::ListMethodsParams::params()
+{
+  static RpcParams<ListMethodsParams> const p = RpcParams<ListMethodsParams>()
+    .field("service", &ListMethodsParams::Service, true, "service to list the methods of");
+  return p;
+}
+
 cJSON*
 RpcServer::RpcSystemService::getServerPublicKey(cJSON const* req)
 {
@@ -563,26 +1111,29 @@ RpcServer::RpcSystemService::listServices(cJSON const* UNUSED_PARAM(req))
 }
 
 cJSON*
-RpcServer::RpcSystemService::listMethods(cJSON const* req)
+RpcServer::RpcSystemService::listMethods(ListMethodsParams const& params)
 {
+  auto itr = m_server->m_services.find(params.Service);
+  if (itr == m_server->m_services.end())
+    return JsonRpc::makeError(ENOENT, "service %s not found", params.Service);
+
   cJSON* res = cJSON_CreateObject();
-  cJSON const* service = JsonRpc::search(req, "/params/service", true);
-  if (service)
+  cJSON* names = cJSON_CreateArray();
+  cJSON* schemas = cJSON_CreateObject();
+  for (std::string const& s : itr->second->methodNames())
   {
-    // cJSON* names = cJSON_AddArrayToObject(res, "methods");
-    cJSON* names = cJSON_CreateArray();
-    auto itr = m_server->m_services.find(service->valuestring);
-    for (std::string const& s : itr->second->methodNames())
-    {
-      RpcMethodInfo methodInfo(service->valuestring, s);
-      cJSON_AddItemToArray(names, cJSON_CreateString(methodInfo.toString().c_str()));
-    }
-    cJSON_AddItemToObject(res, "methods", names);
+    std::string const name = RpcMethodInfo(params.Service, s).toString();
+    cJSON_AddItemToArray(names, cJSON_CreateString(name.c_str()));
+
+    cJSON* schema = itr->second->paramsSchema(s);
+    if (schema)
+      cJSON_AddItemToObject(schemas, name.c_str(), schema);
   }
+  cJSON_AddItemToObject(res, "methods", names);
+  cJSON_AddItemToObject(res, "schemas", schemas);
   return res;
 }
 
-
 std::string chomp(char const* s)
 {
   std::string t(s);
@@ -16,23 +16,60 @@
 #ifndef __RPC_SERVER_H__
 #define __RPC_SERVER_H__
 
-#include <condition_variable>
+#include <atomic>
+#include <chrono>
 #include <functional>
 #include <map>
 #include <memory>
 #include <mutex>
-#include <queue>
+#include <deque>
+#include <set>
 #include <thread>
+#include <vector>
+
+#include <semaphore.h>
+
+#include "dispatch_table.h"
+#include "jsonarena.h"
+#include "mpsc_queue.h"
+#include "rpcparams.h"
 
 
 struct cJSON;
 class RpcService;
+class RpcConnectedClient;
+class RpcResponseStream;
 
 using RpcDataHandler = std::function<void (char const* buff, int n)>;
 using RpcNotificationFunction = std::function<void (cJSON const* json)>;
 using RpcMethod = std::function<cJSON* (cJSON const* req)>;
 using RpcMethodMap = std::map< std::string, RpcMethod >;
 using RpcServiceConstructor = std::function<RpcService* ()>;
+using RpcClientHandler = std::function<void (std::shared_ptr<RpcConnectedClient> const& client)>;
+using RpcClientMap = std::map< int, std::shared_ptr<RpcConnectedClient> >;
+using RpcResponseStreamFactory = std::function<std::unique_ptr<RpcResponseStream> (cJSON const* req)>;
+
+// Serialized methods of a service run one at a time, in the order they
+// arrived, across every connected client. Parallel methods may run on any
+// free worker alongside anything else.
+enum class RpcConcurrency
+{
+  Serialized,
+  Parallel
+};
+
+// names the strand a request for a parallel method runs on. Requests whose
+// strands match run one at a time in the order they arrived, an empty
+// strand runs alongside anything
+using RpcStrandFunction = std::function<std::string (cJSON const* req)>;
+
+struct RpcMethodEntry
+{
+  std::string       Name;
+  RpcMethod         Method;
+  RpcConcurrency    Concurrency;
+  RpcStrandFunction Strand;
+};
 
 struct DeviceInfoProvider
 {
@@ -52,8 +89,38 @@ public:
   virtual ~RpcConnectedClient() { }
   virtual void init(DeviceInfoProvider const& deviceInfoProvider) = 0;
   virtual void enqueueForSend(char const* buff, int n) = 0;
-  virtual void run() = 0;
+
+  // takes ownership of a serialized record. transports that queue whole
+  // buffers override this to keep the record without copying it
+  virtual void enqueueForSend(std::vector<char>&& record)
+    {
+      if (!record.empty())
+        enqueueForSend(&record[0], static_cast<int>(record.size()));
+    }
+
   virtual void setDataHandler(RpcDataHandler const& handler) = 0;
+
+  // a record too large to build up front is queued in parts between
+  // beginRecord and endRecord. Only one is open per client at a time, other
+  // writers wait in beginRecord, and whole records sent in the meantime go
+  // out after it
+  void beginRecord();
+  void appendToRecord(std::vector<char>&& part);
+  void endRecord(std::vector<char>&& part);
+
+  // blocks until no more than limit bytes are queued for the client. false
+  // if it didn't drain that far within timeout
+  virtual bool waitForSendSpace(size_t limit, std::chrono::milliseconds timeout);
+
+protected:
+  // transports that can send the start of a record before the rest is
+  // written override this. The default collects the parts and queues the
+  // whole record when the last one arrives
+  virtual void enqueuePartial(std::vector<char>&& part, bool last);
+
+private:
+  std::mutex        m_record_mutex;
+  std::vector<char> m_partial_record;
 };
 
 class RpcService
@@ -65,6 +132,20 @@ public:
   virtual std::string name() const = 0;
   virtual std::vector<std::string> methodNames() const = 0;
   virtual cJSON* invokeMethod(std::string const& name, cJSON const* req) = 0;
+  virtual RpcConcurrency concurrency(std::string const& name) const = 0;
+
+  // every method the service exposes, by method name without the service
+  // prefix. The server builds its dispatch table from these once all the
+  // services are registered. The default goes through invokeMethod
+  virtual std::vector<RpcMethodEntry> methods();
+
+  // schema of the params the method takes, or null if it doesn't declare
+  // them. The caller owns the result
+  virtual cJSON* paramsSchema(std::string const& name) const;
+
+  // how the service opens a stream for a large result. Set by the server
+  // before init
+  virtual void setResponseStreamFactory(RpcResponseStreamFactory const& factory);
 
 public:
   static void registerServiceConstructor(std::string const& name, RpcServiceConstructor const& ctor);
@@ -87,19 +168,64 @@ public:
   virtual std::string name() const override;
   virtual std::vector<std::string> methodNames() const override;
   virtual cJSON* invokeMethod(std::string const& name, cJSON const* req) override;
+  virtual RpcConcurrency concurrency(std::string const& name) const override;
+  virtual std::vector<RpcMethodEntry> methods() override;
+  virtual cJSON* paramsSchema(std::string const& name) const override;
+  virtual void setResponseStreamFactory(RpcResponseStreamFactory const& factory) override;
   virtual void init(cJSON const* conf, RpcNotificationFunction const& callback) override;
 
 protected:
-  void registerMethod(std::string const& name, RpcMethod const& method);
+  void registerMethod(std::string const& name, RpcMethod const& method,
+    RpcConcurrency concurrency = RpcConcurrency::Serialized);
+
+  // orders requests for a parallel method by something narrower than the
+  // service, like the device they act on, so they queue for a worker
+  // instead of holding one while they wait for each other
+  void setStrand(std::string const& name, RpcStrandFunction const& strand);
+
+  // registers a method that takes typed params. The request's params are
+  // bound onto a P before the method is called, and a request whose params
+  // don't match gets an invalid params error without reaching it
+  template<class P>
+  void registerMethod(std::string const& name,
+    std::function<cJSON* (P const& params, cJSON const* req)> const& method,
+    RpcConcurrency concurrency = RpcConcurrency::Serialized)
+  {
+    registerMethod(name, [method](cJSON const* req) -> cJSON*
+      {
+        P params = P();
+        std::string error;
+        if (!RpcParamTraits<P>::bind(paramsOf(req), params, RpcParamPath { "params", nullptr }, error))
+          return invalidParams(error);
+        return method(params, req);
+      }, concurrency);
+    m_schemas[name] = &RpcParamTraits<P>::schema;
+  }
+
   void notifyAndDelete(cJSON* json);
 
+  // sends result as an interim response to the request with id requestId.
+  // It's marked "progress":true so clients can tell it from the final one,
+  // and result is deleted
+  void notifyProgress(int requestId, cJSON* result);
+
+  // see RpcResponseStream. The method returns whatever finish() returns
+  std::unique_ptr<RpcResponseStream> openResponseStream(cJSON const* req);
+
+  static cJSON const* paramsOf(cJSON const* req);
+  static cJSON* invalidParams(std::string const& error);
+
 protected:
   cJSON*                  m_config;
 
 private:
   RpcMethodMap            m_methods;
+  std::map< std::string, RpcConcurrency > m_concurrency;
+  std::map< std::string, RpcStrandFunction > m_strands;
+  std::map< std::string, std::function<cJSON* ()> > m_schemas;
   std::string             m_name;
   RpcNotificationFunction m_notify;
+  RpcResponseStreamFactory m_open_stream;
 };
 
 class RpcListener
@@ -108,11 +234,16 @@ public:
   RpcListener() { }
   virtual ~RpcListener() { }
   virtual void init(cJSON const* conf) = 0;
-  virtual std::shared_ptr<RpcConnectedClient>
-    accept(DeviceInfoProvider const& deviceInfoProvider) = 0;
+
+  // runs the listener's event loop. Every accepted connection is handed to
+  // onConnect and onDisconnect is called when it goes away. Connections are
+  // accepted while others are being served.
+  virtual void run(DeviceInfoProvider const& deviceInfoProvider,
+    RpcClientHandler const& onConnect, RpcClientHandler const& onDisconnect) = 0;
 
 public:
-  static std::shared_ptr<RpcListener> create();
+  // picks the listener named in conf, ble, unix or tcp
+  static std::shared_ptr<RpcListener> create(cJSON const* conf);
 };
 
 class RpcServer
@@ -129,8 +260,14 @@ private:
     virtual ~RpcSystemService();
     virtual void init(cJSON const* conf, RpcNotificationFunction const& callback) override;
   private:
+    struct ListMethodsParams
+    {
+      char const* Service;
+      static RpcParams<ListMethodsParams> const& params();
+    };
+
     cJSON* listServices(cJSON const* req);
-    cJSON* listMethods(cJSON const* req);
+    cJSON* listMethods(ListMethodsParams const& params);
     cJSON* getServerPublicKey(cJSON const* req);
     cJSON* setClientPublicKey(cJSON const* req);
   private:
@@ -149,35 +286,111 @@ private:
     static RpcMethodInfo parseMethod(char const* s);
   };
 
+  // a JSON-RPC batch. Each member is queued on its own and the last one to
+  // finish sends the combined response. Members can run on different
+  // workers at the same time so each one builds its response in its own
+  // arena, all of which live as long as the batch
+  struct RpcBatch
+  {
+    RpcBatch(int sessionId, cJSON* req, std::unique_ptr<JsonArena>&& arena);
+    ~RpcBatch();
+    int const           SessionId;
+    std::unique_ptr<JsonArena> Arena;
+    std::vector< std::unique_ptr<JsonArena> > MemberArenas;
+    cJSON* const        Request;
+    std::vector<cJSON*> Responses;
+    std::atomic<int>    Pending;
+  };
+
+  struct RpcIncomingRequest
+  {
+    RpcIncomingRequest()
+      : SessionId(-1)
+      , Request(nullptr)
+      , BatchIndex(-1) { }
+
+    int         SessionId;
+
+    // owned by the queue unless it's a member of Batch
+    cJSON*      Request;
+
+    // requests with the same strand run one after the other, an empty
+    // strand can run on any worker
+    std::string Strand;
+
+    std::shared_ptr<RpcBatch> Batch;
+    int         BatchIndex;
+
+    // holds the request and everything built while handling it, null when
+    // arenas are turned off or for batch members
+    std::unique_ptr<JsonArena> Arena;
+  };
+
   friend class RpcSystemService;
 
 public:
-  void setClient(std::shared_ptr<RpcConnectedClient> const& tport);
-  void registerService(std::shared_ptr<RpcService> const& service);
-  void stop();
-  void run();
+  int addClient(std::shared_ptr<RpcConnectedClient> const& client);
+  void removeClient(std::shared_ptr<RpcConnectedClient> const& client);
   void enqueueAsyncMessage(cJSON const* json);
-  void onIncomingMessage(const char* buff, int n);
+  void onIncomingMessage(int sessionId, const char* buff, int n);
   void setLastChanceHandler(RpcMethod const& lastChanceHandler);
 
 private:
+  // a method as routed by the server, keyed in m_dispatch on its full wire
+  // name
+  struct RpcDispatchEntry
+  {
+    std::string       ServiceName;
+    RpcMethod         Method;
+    RpcConcurrency    Concurrency;
+    RpcStrandFunction Strand;
+  };
+
+  void registerService(std::shared_ptr<RpcService> const& service);
+  void buildDispatchTable();
   void processIncomingQueue();
-  void processRequest(cJSON const* req);
+  void enqueueRequest(RpcIncomingRequest&& incoming);
+  void drainIntake();
+  bool nextRunnableRequest(RpcIncomingRequest& incoming);
+  bool hasRunnableRequest() const;
+  std::string strandOf(cJSON const* req) const;
+  void processRequest(int sessionId, cJSON const* req);
+  void processBatchMember(RpcIncomingRequest const& incoming);
+  cJSON* createResponse(cJSON const* req);
+  void sendResponse(int sessionId, cJSON const* res);
+  void sendJson(int sessionId, cJSON const* json);
+  void sendToSession(int sessionId, std::vector<char>&& record);
   cJSON* processJsonRpcRequest(cJSON const* req);
   cJSON* processNonJsonRpcRequest(cJSON const* req);
-  cJSON* invokeMethod(RpcMethodInfo const& methodInfo, cJSON const* req);
+  cJSON* invokeMethod(char const* name, cJSON const* req);
+  cJSON* methodNotFound(char const* name) const;
+  std::unique_ptr<RpcResponseStream> openResponseStream(cJSON const* req);
 
 private:
-  std::shared_ptr<RpcConnectedClient> m_client;
-  std::mutex                          m_mutex;
-  std::shared_ptr<std::thread>        m_dispatch_thread;
-  std::queue<cJSON *>                 m_incoming_queue;
-  std::condition_variable             m_cond;
+  // copy on write, readers take a snapshot with std::atomic_load and never
+  // lock. m_clients_mutex only serializes add/remove.
+  std::shared_ptr<RpcClientMap const> m_clients;
+  std::mutex                          m_clients_mutex;
+  int                                 m_next_session_id;
+  std::vector< std::shared_ptr<std::thread> > m_workers;
+
+  // transports push parsed requests onto the intake without locking. The
+  // workers move them into m_incoming_queue under m_schedule_mutex, which
+  // nothing outside the worker pool takes.
+  mpsc_queue<RpcIncomingRequest>      m_intake;
+  std::mutex                          m_schedule_mutex;
+  std::deque<RpcIncomingRequest>      m_incoming_queue;
+  std::set<std::string>               m_busy_strands;
+  sem_t                               m_work_available;
   std::map< std::string, std::shared_ptr<RpcService> > m_services;
+
+  // built once the services are registered and read only after that
+  dispatch_table<RpcDispatchEntry>    m_dispatch;
   cJSON*                              m_config;
   std::string                         m_config_file;
   RpcMethod                           m_last_chance;
-  bool                                m_running;
+  std::atomic<bool>                   m_running;
+  bool                                m_use_arena;
 };
 
 // not sure where to put these
@@ -0,0 +1,301 @@
+//
+// Copyright [2018] [Comcast, Corp]
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#include "rpcstream.h"
+#include "defs.h"
+#include "jsonwriter.h"
+#include "rpclogger.h"
+#include "rpcserver.h"
+
+#include <cJSON.h>
+
+#include <stdio.h>
+#include <string.h>
+
+namespace
+{
+  inline void append(std::vector<char>& out, char const* s)
+  {
+    out.insert(out.end(), s, s + strlen(s));
+  }
+}
+
+RpcResponseStream::RpcResponseStream()
+  : m_client()
+  , m_request_id(-1)
+  , m_chunk_size(0)
+  , m_high_water(0)
+  , m_timeout(0)
+  , m_on_streamed()
+  , m_buff()
+  , m_closers()
+  , m_result_depth(0)
+  , m_state(State::Idle)
+  , m_queued(false)
+  , m_first_item(true)
+  , m_first_member(true)
+  , m_stalled(false)
+{
+}
+
+RpcResponseStream::RpcResponseStream(std::shared_ptr<RpcConnectedClient> const& client,
+  int requestId, size_t chunkSize, size_t highWater, std::chrono::milliseconds timeout,
+  std::function<void ()> const& onStreamed)
+  : m_client(client)
+  , m_request_id(requestId)
+  , m_chunk_size(chunkSize)
+  , m_high_water(highWater)
+  , m_timeout(timeout)
+  , m_on_streamed(onStreamed)
+  , m_buff()
+  , m_closers()
+  , m_result_depth(0)
+  , m_state(State::Idle)
+  , m_queued(false)
+  , m_first_item(true)
+  , m_first_member(true)
+  , m_stalled(false)
+{
+  m_buff.reserve(m_chunk_size + m_chunk_size / 4);
+}
+
+RpcResponseStream::~RpcResponseStream()
+{
+  // a method that bailed out part way still has to close the record so the
+  // client's framing stays intact. Nothing has gone out if no part was
+  // queued, and the server sends the method's error as usual
+  if (m_state == State::Open && m_queued)
+  {
+    closeResult(nullptr, true);
+    send(true);
+  }
+}
+
+void
+RpcResponseStream::begin(cJSON const* head, char const* name)
+{
+  if (m_state != State::Idle)
+    return;
+
+  if (m_client)
+  {
+    open('{', '}');
+    append(m_buff, "\"jsonrpc\":\"" kJsonRpcVersion "\",");
+    if (m_request_id != -1)
+    {
+      char buff[32];
+      snprintf(buff, sizeof(buff), "\"id\":%d,", m_request_id);
+      append(m_buff, buff);
+    }
+    append(m_buff, "\"result\":");
+  }
+
+  // head's members go first, then the array takes the place of its closing
+  // brace
+  m_result_depth = m_closers.size();
+  if (head && cJSON_IsObject(head))
+  {
+    JsonWriter::write(head, m_buff);
+    m_buff.pop_back();
+    if (m_buff.back() != '{')
+      m_buff.push_back(',');
+    m_closers.push_back('}');
+  }
+  else
+  {
+    open('{', '}');
+  }
+
+  JsonWriter::writeString(name, strlen(name), m_buff);
+  m_buff.push_back(':');
+  open('[', ']');
+  m_state = State::Open;
+}
+
+void
+RpcResponseStream::writeItem(cJSON const* item)
+{
+  if (m_state != State::Open || !item)
+    return;
+
+  separate(m_first_item);
+  JsonWriter::write(item, m_buff);
+  itemWritten();
+}
+
+void
+RpcResponseStream::beginItem()
+{
+  if (m_state != State::Open)
+    return;
+
+  separate(m_first_item);
+  open('{', '}');
+  m_first_member = true;
+}
+
+void
+RpcResponseStream::addString(char const* name, char const* value, size_t n)
+{
+  if (m_state != State::Open)
+    return;
+
+  separate(m_first_member);
+  JsonWriter::writeString(name, strlen(name), m_buff);
+  m_buff.push_back(':');
+  JsonWriter::writeString(value, n, m_buff);
+}
+
+void
+RpcResponseStream::endItem()
+{
+  if (m_state != State::Open)
+    return;
+
+  close(1);
+  itemWritten();
+}
+
+cJSON*
+RpcResponseStream::finish(cJSON const* tail)
+{
+  if (m_state == State::Idle)
+    begin(nullptr, "results");
+  if (m_state != State::Open)
+    return nullptr;
+
+  m_state = State::Finished;
+  closeResult(tail, m_stalled);
+
+  if (!m_client)
+  {
+    m_buff.push_back('\0');
+    return cJSON_CreateRaw(&m_buff[0]);
+  }
+
+  send(true);
+  return nullptr;
+}
+
+void
+RpcResponseStream::closeResult(cJSON const* tail, bool truncated)
+{
+  // back out to the result object, which may mean closing an item the
+  // method gave up on
+  close(m_closers.size() - (m_result_depth + 1));
+
+  if (truncated)
+  {
+    append(m_buff, ",\"truncated\":true");
+  }
+  else if (tail && cJSON_IsObject(tail))
+  {
+    // the object's braces are dropped, a comma takes the place of the
+    // opening one
+    size_t start = m_buff.size();
+    JsonWriter::write(tail, m_buff);
+    m_buff.pop_back();
+    if (m_buff.size() == start + 1)
+      m_buff.pop_back();
+    else
+      m_buff[start] = ',';
+  }
+
+  close(m_closers.size());
+}
+
+void
+RpcResponseStream::open(char c, char closer)
+{
+  m_buff.push_back(c);
+  m_closers.push_back(closer);
+}
+
+void
+RpcResponseStream::close(size_t n)
+{
+  for (; n > 0 && !m_closers.empty(); --n)
+  {
+    m_buff.push_back(m_closers.back());
+    m_closers.pop_back();
+  }
+}
+
+void
+RpcResponseStream::separate(bool& first)
+{
+  if (first)
+    first = false;
+  else
+    m_buff.push_back(',');
+}
+
+void
+RpcResponseStream::itemWritten()
+{
+  if (m_client && m_buff.size() >= m_chunk_size)
+    flush();
+}
+
+void
+RpcResponseStream::flush()
+{
+  // once the client has stopped reading there's no point queueing more,
+  // the rest is dropped and only the closing brackets go out. The first
+  // part carries the response's head, so it's queued regardless
+  if (!m_stalled && !m_client->waitForSendSpace(m_high_water, m_timeout))
+  {
+    XLOG_WARN("client stopped reading, dropping the rest of a streamed response");
+    m_stalled = true;
+    if (!m_queued)
+    {
+      send(false);
+      return;
+    }
+  }
+
+  if (m_stalled)
+  {
+    m_buff.clear();
+    return;
+  }
+
+  send(false);
+}
+
+void
+RpcResponseStream::send(bool last)
+{
+  // the record is opened with the first part. From then on the response is
+  // this stream's to finish, whatever the method does afterwards
+  if (!m_queued)
+  {
+    m_client->beginRecord();
+    m_queued = true;
+    if (m_on_streamed)
+      m_on_streamed();
+  }
+
+  if (last)
+  {
+    m_client->endRecord(std::move(m_buff));
+    m_buff = std::vector<char>();
+    return;
+  }
+
+  m_client->appendToRecord(std::move(m_buff));
+  m_buff = std::vector<char>();
+  m_buff.reserve(m_chunk_size + m_chunk_size / 4);
+}
@@ -0,0 +1,129 @@
+//
+// Copyright [2018] [Comcast, Corp]
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#ifndef __RPC_STREAM_H__
+#define __RPC_STREAM_H__
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <stddef.h>
+
+struct cJSON;
+class RpcConnectedClient;
+
+// Writes a result that is mostly one long array straight to the client in
+// transport sized parts, instead of building the whole tree first:
+//
+//   std::unique_ptr<RpcResponseStream> stream = openResponseStream(req);
+//   stream->begin(head, "results");
+//   for (...)
+//   {
+//     stream->beginItem();
+//     stream->addString("ssid", ssid, n);
+//     stream->endItem();
+//   }
+//   return stream->finish();
+//
+// The result is an object holding head's members followed by the array,
+// then tail's members if finish() is given one.
+// Each part is queued once it reaches the chunk size, after waiting for the
+// client to drain below its high water mark, so memory stays bounded no
+// matter how long the array gets and the client sees the first part while
+// the rest is still being produced.
+//
+// Streams for batch members, or when the client can't be found, collect the
+// result instead and finish() returns it as a raw value that's sent like any
+// other.
+class RpcResponseStream
+{
+public:
+  // collects the result for finish() to return
+  RpcResponseStream();
+
+  // sends the response to client as it's written. onStreamed runs when the
+  // first part is queued, after which the client has part of the response
+  // and nothing else may be sent for the request
+  RpcResponseStream(std::shared_ptr<RpcConnectedClient> const& client, int requestId,
+    size_t chunkSize, size_t highWater, std::chrono::milliseconds timeout,
+    std::function<void ()> const& onStreamed);
+
+  ~RpcResponseStream();
+
+  // head may be null
+  void begin(cJSON const* head, char const* name);
+
+  void writeItem(cJSON const* item);
+
+  // an item that's an object of string members, written without a tree
+  void beginItem();
+  void addString(char const* name, char const* value, size_t n);
+  void endItem();
+
+  // null once the response has been sent, otherwise the collected result.
+  // tail's members follow the array. A result that's cut short, because the
+  // client stalled or the method gave up before finishing, gets
+  // "truncated":true instead, so anything that's only valid for the whole
+  // result belongs in tail rather than head
+  cJSON* finish(cJSON const* tail = nullptr);
+
+  // true if the client stopped reading and the rest of the result was
+  // dropped
+  bool stalled() const
+    { return m_stalled; }
+
+private:
+  RpcResponseStream(RpcResponseStream const&) = delete;
+  RpcResponseStream& operator=(RpcResponseStream const&) = delete;
+
+  void separate(bool& first);
+  void closeResult(cJSON const* tail, bool truncated);
+  void open(char c, char closer);
+  void close(size_t n);
+  void itemWritten();
+  void flush();
+  void send(bool last);
+
+private:
+  enum class State
+  {
+    Idle,
+    Open,
+    Finished
+  };
+
+  std::shared_ptr<RpcConnectedClient> m_client;
+  int                       m_request_id;
+  size_t                    m_chunk_size;
+  size_t                    m_high_water;
+  std::chrono::milliseconds m_timeout;
+  std::function<void ()>    m_on_streamed;
+  std::vector<char>         m_buff;
+
+  // what closes each object and array that's open, innermost last
+  std::vector<char>         m_closers;
+
+  // where the result object's closer is in m_closers
+  size_t                    m_result_depth;
+  State                     m_state;
+  bool                      m_queued;
+  bool                      m_first_item;
+  bool                      m_first_member;
+  bool                      m_stalled;
+};
+
+#endif
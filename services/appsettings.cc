@@ -16,15 +16,23 @@
 #include "appsettings.h"
 #include "../rpclogger.h"
 #include "../jsonrpc.h"
+#include "../reactor.h"
 
 #include <glib.h>
 #include <string.h>
 #include <sstream>
+#include <sys/wait.h>
 
 namespace
 {
   char const* kDefaultGroupName = "user";
 
+  // seconds a dynamic property's command may run when its configuration
+  // doesn't give a "timeout"
+  int const kDefaultExecTimeout = 10;
+
+  JsonPath const kDynamicPropertiesPath("/settings/dynamic_properties");
+
   GKeyFile* keyFile = g_key_file_new();
 
   gchar*
@@ -56,11 +64,10 @@ namespace
   };
 
   cJSON*
-  exec(cJSON const* req, cJSON const* conf, DynamicPropertyOperation op)
+  exec(char const* key, char const* value, cJSON const* conf, DynamicPropertyOperation op)
   {
     cJSON* res = nullptr;
 
-    char const* key = JsonRpc::getString(req, "/params/key", true);
     XLOG_INFO("executing command for setting %s", key);
 
     std::string cmdline = JsonRpc::getString(conf, "exec", true);
@@ -71,50 +78,46 @@ namespace
     }
     else
     {
-      char const* value = JsonRpc::getString(req, "/params/value", true);
       cmdline += " set ";
       cmdline += key;
       cmdline + " ";
       cmdline + value;
     }
 
-    g_autofree gchar* out = nullptr;
-    g_autofree gchar* err = nullptr;
-    gint exit_status = 0;
-    g_autoptr(GError) error = nullptr;
-    gboolean b = g_spawn_command_line_sync(cmdline.c_str(), &out, &err, &exit_status, &error);
+    std::chrono::seconds timeout(JsonRpc::getInt(conf, "timeout", false, kDefaultExecTimeout));
 
-    XLOG_INFO("ret:%d", b);
-    XLOG_INFO("out:%s", out);
-    XLOG_INFO("err:%s", err);
-    XLOG_INFO("status:%d", exit_status);
+    int status = 0;
+    std::string out;
+    std::string err;
+    int ret = Reactor::main().runProcess(cmdline, timeout, status, out, err);
 
-    if (error)
-      XLOG_INFO("error:%d", error->code);
+    int exit_status = ret == 0 && WIFEXITED(status) ? WEXITSTATUS(status) : -1;
 
-    if (b && out && (exit_status == 0))
+    XLOG_INFO("ret:%d", ret);
+    XLOG_INFO("out:%s", out.c_str());
+    XLOG_INFO("err:%s", err.c_str());
+    XLOG_INFO("status:%d", exit_status);
+
+    if (ret == 0 && exit_status == 0)
     {
       if (op == DynamicPropertyOperation::Get)
       {
-        std::string value = chomp(out);
-        res = cJSON_CreateString(value.c_str());
+        std::string result = chomp(out.c_str());
+        res = cJSON_CreateString(result.c_str());
       }
       else
       {
         res = cJSON_CreateNumber(0);
       }
     }
+    else if (ret != 0)
+    {
+      res = JsonRpc::makeError(ret, "failed to execute %s. %s", cmdline.c_str(), strerror(ret));
+    }
     else
     {
-      int code = exit_status;
-      if (code == 0)
-        code = -1;
-
-      char const* message = nullptr;
-      if (error)
-        message = error->message;
-
-      res = JsonRpc::makeError(code, "failed to execute %s. %s", cmdline.c_str(), message);
+      res = JsonRpc::makeError(exit_status, "failed to execute %s. %s", cmdline.c_str(),
+        chomp(err.c_str()).c_str());
     }
 
     return res;
@@ -154,18 +157,39 @@ AppSettingsService::init(cJSON const* conf, RpcNotificationFunction const& callb
     }
   }
 
-  registerMethod("get", [this](cJSON const* req) -> cJSON* { return this->get(req); });
-  registerMethod("set", [this](cJSON const* req) -> cJSON* { return this->set(req); });
+  registerMethod<GetParams>("get",
+    [this](GetParams const& params, cJSON const* UNUSED_PARAM(req)) -> cJSON*
+      { return this->get(params); });
+  registerMethod<SetParams>("set",
+    [this](SetParams const& params, cJSON const* UNUSED_PARAM(req)) -> cJSON*
+      { return this->set(params); });
   registerMethod("get-status", [this](cJSON const* req) -> cJSON* { return this->getStatus(req); });
   registerMethod("get-keys", [this](cJSON const* req) -> cJSON* { return this->getKeys(req); });
 }
 
+RpcParams<AppSettingsService::GetParams> const&
+AppSettingsService::GetParams::params()
+{
+  static RpcParams<GetParams> const p = RpcParams<GetParams>()
+    .field("key", &GetParams::Key);
+  return p;
+}
+
+RpcParams<AppSettingsService::SetParams> const&
+AppSettingsService::SetParams::params()
+{
+  static RpcParams<SetParams> const p = RpcParams<SetParams>()
+    .field("key", &SetParams::Key)
+    .field("value", &SetParams::Value);
+  return p;
+}
+
 cJSON const*
 AppSettingsService::getDynamicConfig(char const* s) const
 {
   XLOG_INFO("checking for dynamic property %s", s);
 
-  cJSON const* dynamicProperties = JsonRpc::search(m_config, "/settings/dynamic_properties", false);
+  cJSON const* dynamicProperties = JsonRpc::search(m_config, kDynamicPropertiesPath, false);
   if (dynamicProperties)
   {
     XLOG_DEBUG("checking dynamic properties");
@@ -179,10 +203,8 @@ AppSettingsService::getDynamicConfig(char const* s) const
   }
   else
   {
-    char* s = cJSON_Print(m_config);
     XLOG_DEBUG("no dynamic properties configured");
-    XLOG_DEBUG("%s", s);
-    free(s);
+    XLOG_JSON(RpcLogLevel::Debug, m_config);
   }
   return nullptr;
 }
@@ -192,7 +214,7 @@ AppSettingsService::getKeys(cJSON const* UNUSED_PARAM(req))
 {
   cJSON* res = cJSON_CreateArray();
 
-  cJSON const* dynamicProperties = JsonRpc::search(m_config, "/settings/dynamic_properties", false);
+  cJSON const* dynamicProperties = JsonRpc::search(m_config, kDynamicPropertiesPath, false);
   if (dynamicProperties)
   {
     for (int i = 0, n = cJSON_GetArraySize(dynamicProperties); i < n; ++i)
@@ -217,16 +239,16 @@ AppSettingsService::getKeys(cJSON const* UNUSED_PARAM(req))
 }
 
 cJSON*
-AppSettingsService::get(cJSON const* req)
+AppSettingsService::get(GetParams const& params)
 {
   cJSON* res = nullptr;
 
-  char const* key = JsonRpc::getString(req, "/params/key", true);
+  char const* key = params.Key;
 
   cJSON const* conf = getDynamicConfig(key);
   if (conf)
   {
-    res = exec(req, conf, DynamicPropertyOperation::Get);
+    res = exec(key, nullptr, conf, DynamicPropertyOperation::Get);
   }
   else
   {
@@ -247,7 +269,8 @@ AppSettingsService::get(cJSON const* req)
     }
     else
     {
-      cJSON_AddItemToObject(res, "name",  cJSON_CreateString(JsonRpc::getString(req, "/params/key", true)));
+      res = cJSON_CreateObject();
+      cJSON_AddItemToObject(res, "name",  cJSON_CreateString(key));
       cJSON_AddItemToObject(res, "value", cJSON_CreateString(value));
     }
   }
@@ -256,22 +279,20 @@ AppSettingsService::get(cJSON const* req)
 }
 
 cJSON*
-AppSettingsService::set(cJSON const* req)
+AppSettingsService::set(SetParams const& params)
 {
   cJSON* res = nullptr;
 
-  char const* key = JsonRpc::getString(req, "/params/key", true);
+  char const* key = params.Key;
+  char const* value = params.Value;
 
   cJSON const* conf = getDynamicConfig(key);
   if (conf)
   {
-    res = exec(req, m_config, DynamicPropertyOperation::Set);
+    res = exec(key, value, m_config, DynamicPropertyOperation::Set);
   }
   else
   {
-    char const* key = JsonRpc::getString(req, "/params/key", true);
-    char const* value = JsonRpc::getString(req, "/params/value", true);
-
     g_autoptr(GError) error = nullptr;
     g_key_file_set_value(keyFile, kDefaultGroupName, key, value);
     if (!g_key_file_save_to_file(keyFile, m_config_file.c_str(), &error))
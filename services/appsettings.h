@@ -27,8 +27,21 @@ public:
   virtual void init(cJSON const* conf, RpcNotificationFunction const& callback) override;
 
 private:
-  cJSON* get(cJSON const* req);
-  cJSON* set(cJSON const* req);
+  struct GetParams
+  {
+    char const* Key;
+    static RpcParams<GetParams> const& params();
+  };
+
+  struct SetParams
+  {
+    char const* Key;
+    char const* Value;
+    static RpcParams<SetParams> const& params();
+  };
+
+  cJSON* get(GetParams const& params);
+  cJSON* set(SetParams const& params);
   cJSON* getStatus(cJSON const* req);
   cJSON* getKeys(cJSON const* req);
 
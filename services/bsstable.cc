@@ -0,0 +1,259 @@
+//
+// Copyright [2018] [Comcast, Corp]
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#include "bsstable.h"
+#include "wpareply.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+namespace
+{
+  // levels within the same bucket are the same for a delta, roughly one
+  // bar on a signal meter
+  int const kLevelBucket = 10;
+
+  // removals older than this many are forgotten, a client that far behind
+  // gets the full list
+  size_t const kMaxTombstones = 256;
+
+  int
+  levelBucket(std::string const& level)
+  {
+    int n = static_cast<int>(strtol(level.c_str(), nullptr, 10));
+    return n >= 0 ? n / kLevelBucket : -((-n + kLevelBucket - 1) / kLevelBucket);
+  }
+
+  // generations start from the wall clock so a token handed out before a
+  // restart is always older than anything this process knows about
+  uint64_t
+  initialGeneration()
+  {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count());
+  }
+}
+
+BssTable::BssTable()
+  : m_mutex()
+  , m_entries()
+  , m_removed()
+  , m_last_reload()
+  , m_generation(initialGeneration())
+  , m_oldest(m_generation)
+{
+}
+
+bool
+BssTable::changed(BssEntry const& a, BssEntry const& b)
+{
+  return a.Bssid != b.Bssid
+    || a.Ssid != b.Ssid
+    || a.Freq != b.Freq
+    || a.Flags != b.Flags
+    || levelBucket(a.Level) != levelBucket(b.Level);
+}
+
+void
+BssTable::addTombstone(BssEntry const& entry)
+{
+  BssTombstone t;
+  t.Id = entry.Id;
+  t.Bssid = entry.Bssid;
+  t.Version = m_generation;
+  m_removed.push_back(std::move(t));
+
+  while (m_removed.size() > kMaxTombstones)
+  {
+    m_oldest = m_removed.front().Version;
+    m_removed.pop_front();
+  }
+}
+
+void
+BssTable::add(int id, std::string const& bssid)
+{
+  std::lock_guard<std::mutex> guard(m_mutex);
+  BssEntry& entry = m_entries[id];
+  if (entry.Id == id && entry.Bssid == bssid)
+    return;
+
+  entry.Id = id;
+  entry.Bssid = bssid;
+  entry.LastSeen = clock::now();
+  entry.Version = ++m_generation;
+}
+
+void
+BssTable::remove(int id)
+{
+  std::lock_guard<std::mutex> guard(m_mutex);
+  auto itr = m_entries.find(id);
+  if (itr == m_entries.end())
+    return;
+
+  ++m_generation;
+  addTombstone(itr->second);
+  m_entries.erase(itr);
+}
+
+void
+BssTable::reload(std::vector<BssEntry>&& entries, clock::time_point now)
+{
+  std::map<int, BssEntry> table;
+  for (BssEntry& entry : entries)
+  {
+    int id = entry.Id;
+    table[id] = std::move(entry);
+  }
+
+  std::lock_guard<std::mutex> guard(m_mutex);
+
+  // everything that differs from what's held shares one new generation,
+  // a reload that changes nothing leaves the generation alone
+  uint64_t next = m_generation + 1;
+  bool any = false;
+
+  for (auto& kv : table)
+  {
+    auto itr = m_entries.find(kv.first);
+    if (itr == m_entries.end() || changed(itr->second, kv.second))
+    {
+      kv.second.Version = next;
+      any = true;
+    }
+    else
+    {
+      kv.second.Version = itr->second.Version;
+    }
+  }
+
+  for (auto const& kv : m_entries)
+  {
+    if (table.find(kv.first) == table.end())
+    {
+      m_generation = next;
+      addTombstone(kv.second);
+    }
+  }
+
+  if (any)
+    m_generation = next;
+
+  m_entries.swap(table);
+  m_last_reload = now;
+}
+
+std::vector<BssEntry>
+BssTable::entries() const
+{
+  std::vector<BssEntry> entries;
+
+  std::lock_guard<std::mutex> guard(m_mutex);
+  entries.reserve(m_entries.size());
+  for (auto const& kv : m_entries)
+    entries.push_back(kv.second);
+  return entries;
+}
+
+uint64_t
+BssTable::delta(uint64_t since, std::vector<BssEntry>& changed,
+  std::vector<BssTombstone>& removed, bool& full) const
+{
+  std::lock_guard<std::mutex> guard(m_mutex);
+
+  full = since < m_oldest || since > m_generation;
+  for (auto const& kv : m_entries)
+  {
+    if (full || kv.second.Version > since)
+      changed.push_back(kv.second);
+  }
+
+  if (!full)
+  {
+    for (BssTombstone const& t : m_removed)
+    {
+      if (t.Version > since)
+        removed.push_back(t);
+    }
+  }
+
+  return m_generation;
+}
+
+uint64_t
+BssTable::generation() const
+{
+  std::lock_guard<std::mutex> guard(m_mutex);
+  return m_generation;
+}
+
+BssTable::clock::time_point
+BssTable::lastReload() const
+{
+  std::lock_guard<std::mutex> guard(m_mutex);
+  return m_last_reload;
+}
+
+int
+BssTable::parse(std::string& reply, clock::time_point now, std::vector<BssEntry>& entries)
+{
+  int lastId = -1;
+  bool inEntry = false;
+
+  WpaReply r(reply);
+  WpaReplyField field;
+  while (r.next(field))
+  {
+    // the ==== closing an entry reads as an empty name
+    if (field.NameLength == 0)
+    {
+      if (field.ValueLength == 3 && memcmp(field.Value, "===", 3) == 0)
+        inEntry = false;
+      continue;
+    }
+
+    if (!field.Value)
+      continue;
+
+    if (!inEntry)
+    {
+      entries.push_back(BssEntry());
+      entries.back().LastSeen = now;
+    }
+    inEntry = true;
+
+    BssEntry& entry = entries.back();
+    if (field.is("id"))
+    {
+      entry.Id = static_cast<int>(field.toLong());
+      lastId = entry.Id;
+    }
+    else if (field.is("bssid"))
+      entry.Bssid.assign(field.Value, field.ValueLength);
+    else if (field.is("freq"))
+      entry.Freq.assign(field.Value, field.ValueLength);
+    else if (field.is("level"))
+      entry.Level.assign(field.Value, field.ValueLength);
+    else if (field.is("flags"))
+      entry.Flags.assign(field.Value, field.ValueLength);
+    else if (field.is("ssid"))
+      entry.Ssid.assign(field.Value, field.ValueLength);
+    else if (field.is("age"))
+      entry.LastSeen = now - std::chrono::seconds(field.toLong());
+  }
+
+  return lastId;
+}
@@ -0,0 +1,117 @@
+//
+// Copyright [2018] [Comcast, Corp]
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#ifndef __BSS_TABLE_H__
+#define __BSS_TABLE_H__
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// A BSS as last reported by wpa_supplicant. The values are kept as the text
+// wpa_supplicant sent so they can be written out unchanged
+struct BssEntry
+{
+  BssEntry()
+    : Id(-1)
+    , Version(0) { }
+
+  int         Id;
+  std::string Bssid;
+  std::string Freq;
+  std::string Level;
+  std::string Flags;
+  std::string Ssid;
+
+  // when the radio last saw the BSS
+  std::chrono::steady_clock::time_point LastSeen;
+
+  // table generation the entry last changed in
+  uint64_t Version;
+};
+
+// A BSS that's gone from the table, kept so a delta can report it
+struct BssTombstone
+{
+  int         Id;
+  std::string Bssid;
+  uint64_t    Version;
+};
+
+// In memory copy of wpa_supplicant's BSS list. It's kept up to date from
+// CTRL-EVENT-BSS-ADDED and CTRL-EVENT-BSS-REMOVED as they arrive and
+// reloaded in full once a scan completes, so it can be read at any time
+// without going back to wpa_supplicant. Plain C++ storage, since it lives
+// far longer than any request.
+//
+// Every change moves the table to a new generation and stamps the entries
+// it touched, so a client holding a generation can be sent just what's
+// different. Changes in level smaller than a signal bucket, and in age,
+// don't count.
+class BssTable
+{
+public:
+  using clock = std::chrono::steady_clock;
+
+  BssTable();
+
+  // a BSS wpa_supplicant just added. Only the id and bssid are known until
+  // the next reload
+  void add(int id, std::string const& bssid);
+  void remove(int id);
+
+  // swaps in the full list read after a scan
+  void reload(std::vector<BssEntry>&& entries, clock::time_point now);
+
+  std::vector<BssEntry> entries() const;
+
+  // the entries that changed and the ones removed after generation since,
+  // returning the current generation. If since is unknown or too old to
+  // have its removals on record, full is set and every entry is returned
+  uint64_t delta(uint64_t since, std::vector<BssEntry>& changed,
+    std::vector<BssTombstone>& removed, bool& full) const;
+
+  uint64_t generation() const;
+
+  // when reload was last called, or the epoch if it never has been
+  clock::time_point lastReload() const;
+
+  // parses a BSS RANGE reply with one name=value per line and each entry
+  // closed off by ====, appending to entries. The age wpa_supplicant gives
+  // is taken relative to now. The reply is split up in place. Returns the
+  // last id read, -1 if there were none
+  static int parse(std::string& reply, clock::time_point now,
+    std::vector<BssEntry>& entries);
+
+private:
+  static bool changed(BssEntry const& a, BssEntry const& b);
+  void addTombstone(BssEntry const& entry);
+
+private:
+  mutable std::mutex          m_mutex;
+  std::map<int, BssEntry>     m_entries;
+  std::deque<BssTombstone>    m_removed;
+  clock::time_point           m_last_reload;
+  uint64_t                    m_generation;
+
+  // the oldest generation a delta can still be built from
+  uint64_t                    m_oldest;
+};
+
+#endif
@@ -0,0 +1,233 @@
+//
+// Copyright [2018] [Comcast, Corp]
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#include "connecttracker.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <wpa_ctrl.h>
+
+namespace
+{
+  // these are plain log messages rather than CTRL-EVENTs, there's no define
+  // for them in wpa_ctrl.h
+  char const kTryingToAssociate[] = "Trying to associate with ";
+  char const kTryingToAuthenticate[] = "SME: Trying to authenticate with ";
+  char const kAssociated[] = "Associated with ";
+
+  bool
+  startsWith(char const* s, char const* prefix)
+  {
+    return strncmp(s, prefix, strlen(prefix)) == 0;
+  }
+
+  // the value of name=value in an event, up to the next space or ]. The
+  // name has to start a field, so id= doesn't match inside bssid=
+  std::string
+  eventValue(char const* event, char const* name)
+  {
+    char const* p = strstr(event, name);
+    while (p && p != event && p[-1] != ' ' && p[-1] != '[')
+      p = strstr(p + 1, name);
+    if (!p)
+      return std::string();
+
+    p += strlen(name);
+    return std::string(p, strcspn(p, " ]\n"));
+  }
+
+  // the network id an event is about, -1 if it doesn't say
+  int
+  eventNetworkId(char const* event)
+  {
+    std::string id = eventValue(event, "id=");
+    return id.empty() ? -1 : static_cast<int>(strtol(id.c_str(), nullptr, 10));
+  }
+
+  bool
+  isActive(ConnectProgress const& progress)
+  {
+    return progress.Phase != ConnectPhase::Completed && progress.Phase != ConnectPhase::Failed;
+  }
+}
+
+ConnectTracker::ConnectTracker()
+  : m_mutex()
+  , m_changed()
+  , m_attempts()
+  , m_next_attempt(1)
+  , m_has_address()
+{
+}
+
+int
+ConnectTracker::begin(int networkId)
+{
+  clock::time_point now = clock::now();
+
+  std::lock_guard<std::mutex> guard(m_mutex);
+  for (auto& kv : m_attempts)
+  {
+    if (isActive(kv.second))
+    {
+      kv.second.Reason = "superseded";
+      advance(kv.second, ConnectPhase::Failed, now);
+    }
+  }
+
+  int attempt = m_next_attempt++;
+
+  ConnectProgress& progress = m_attempts[attempt];
+  progress.NetworkId = networkId;
+  progress.Entered[static_cast<int>(ConnectPhase::Selecting)] = now;
+
+  m_changed.notify_all();
+  return attempt;
+}
+
+void
+ConnectTracker::end(int attempt)
+{
+  std::lock_guard<std::mutex> guard(m_mutex);
+  m_attempts.erase(attempt);
+}
+
+void
+ConnectTracker::onEvent(char const* event)
+{
+  clock::time_point now = clock::now();
+
+  std::lock_guard<std::mutex> guard(m_mutex);
+  for (auto& kv : m_attempts)
+  {
+    ConnectProgress& progress = kv.second;
+    if (!isActive(progress))
+      continue;
+
+    int id = eventNetworkId(event);
+    if (id != -1 && id != progress.NetworkId)
+      continue;
+
+    if (startsWith(event, kTryingToAssociate) || startsWith(event, kTryingToAuthenticate))
+    {
+      if (progress.Phase == ConnectPhase::Selecting)
+        advance(progress, ConnectPhase::Associating, now);
+    }
+    else if (startsWith(event, kAssociated))
+    {
+      if (progress.Phase < ConnectPhase::Handshake)
+        advance(progress, ConnectPhase::Handshake, now);
+    }
+    else if (startsWith(event, WPA_EVENT_CONNECTED))
+    {
+      // the handshake is the last thing before CONNECTED
+      advance(progress, ConnectPhase::Dhcp, now);
+      if (m_has_address && m_has_address())
+        advance(progress, ConnectPhase::Completed, now);
+    }
+    else if (startsWith(event, WPA_EVENT_DISCONNECTED))
+    {
+      // wpa_supplicant keeps retrying, so this only sends the attempt back
+      // a step. It's TEMP-DISABLED that gives up
+      progress.Reason = "disconnected reason=" + eventValue(event, "reason=");
+      if (progress.Phase > ConnectPhase::Associating)
+        advance(progress, ConnectPhase::Associating, now);
+    }
+    else if (startsWith(event, WPA_EVENT_ASSOC_REJECT))
+    {
+      progress.Reason = "assoc-reject status_code=" + eventValue(event, "status_code=");
+    }
+    else if (startsWith(event, WPA_EVENT_AUTH_REJECT))
+    {
+      progress.Reason = "auth-reject status_code=" + eventValue(event, "status_code=");
+    }
+    else if (startsWith(event, WPA_EVENT_TEMP_DISABLED))
+    {
+      // reason=WRONG_KEY, CONN_FAILED, AUTH_FAILED...
+      progress.Reason = eventValue(event, "reason=");
+      advance(progress, ConnectPhase::Failed, now);
+    }
+    else if (startsWith(event, WPA_EVENT_NETWORK_NOT_FOUND))
+    {
+      progress.Reason = "network-not-found";
+      advance(progress, ConnectPhase::Failed, now);
+    }
+  }
+}
+
+void
+ConnectTracker::onAddressAdded()
+{
+  clock::time_point now = clock::now();
+
+  std::lock_guard<std::mutex> guard(m_mutex);
+  for (auto& kv : m_attempts)
+  {
+    if (kv.second.Phase == ConnectPhase::Dhcp)
+      advance(kv.second, ConnectPhase::Completed, now);
+  }
+}
+
+void
+ConnectTracker::setAddressCheck(std::function<bool ()> const& hasAddress)
+{
+  std::lock_guard<std::mutex> guard(m_mutex);
+  m_has_address = hasAddress;
+}
+
+bool
+ConnectTracker::wait(int attempt, ConnectPhase seen, clock::time_point deadline,
+  ConnectProgress& progress)
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+
+  auto itr = m_attempts.find(attempt);
+  if (itr == m_attempts.end())
+    return false;
+
+  // the map never moves its nodes, only end() removes them
+  ConnectProgress const& current = itr->second;
+  m_changed.wait_until(lock, deadline, [&current, seen] { return current.Phase != seen; });
+
+  progress = current;
+  return true;
+}
+
+char const*
+ConnectTracker::phaseName(ConnectPhase phase)
+{
+  switch (phase)
+  {
+    case ConnectPhase::Selecting: return "selecting";
+    case ConnectPhase::Associating: return "associating";
+    case ConnectPhase::Handshake: return "handshake";
+    case ConnectPhase::Dhcp: return "dhcp";
+    case ConnectPhase::Completed: return "completed";
+    case ConnectPhase::Failed: return "failed";
+  }
+  return "unknown";
+}
+
+void
+ConnectTracker::advance(ConnectProgress& progress, ConnectPhase phase, clock::time_point now)
+{
+  if (progress.Phase == phase)
+    return;
+
+  progress.Phase = phase;
+  progress.Entered[static_cast<int>(phase)] = now;
+  m_changed.notify_all();
+}
@@ -0,0 +1,101 @@
+//
+// Copyright [2018] [Comcast, Corp]
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#ifndef __CONNECT_TRACKER_H__
+#define __CONNECT_TRACKER_H__
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+
+enum class ConnectPhase
+{
+  Selecting,
+  Associating,
+  Handshake,
+  Dhcp,
+  Completed,
+  Failed
+};
+
+int const kConnectPhaseCount = static_cast<int>(ConnectPhase::Failed) + 1;
+
+struct ConnectProgress
+{
+  ConnectProgress()
+    : Phase(ConnectPhase::Selecting)
+    , NetworkId(-1) { }
+
+  ConnectPhase  Phase;
+  int           NetworkId;
+
+  // why the attempt failed, or the last error wpa_supplicant reported
+  // while retrying
+  std::string   Reason;
+
+  // when each phase was entered, the epoch for ones that were skipped
+  std::chrono::steady_clock::time_point Entered[kConnectPhaseCount];
+};
+
+// Follows each wifi-connect from SELECT_NETWORK through association, the
+// 4-way handshake and DHCP, driven entirely by wpa_supplicant events and the
+// interface getting an address. Nothing is polled, the thread waiting on an
+// attempt is woken when its phase changes.
+class ConnectTracker
+{
+public:
+  using clock = std::chrono::steady_clock;
+
+  ConnectTracker();
+
+  // starts tracking a connect to networkId and returns a handle for it.
+  // wpa_supplicant only connects to one network at a time, so any attempt
+  // still running fails as superseded
+  int begin(int networkId);
+  void end(int attempt);
+
+  // a wpa_supplicant event, without the <level> prefix
+  void onEvent(char const* event);
+
+  // an IPv4 address was added to the interface
+  void onAddressAdded();
+
+  // true if the interface already has an IPv4 address. It's asked when a
+  // connect reaches DHCP, since a reconnect that keeps its lease or a
+  // static address never adds one
+  void setAddressCheck(std::function<bool ()> const& hasAddress);
+
+  // waits until the attempt's phase is something other than seen, or the
+  // deadline passes. Returns false if the attempt isn't known
+  bool wait(int attempt, ConnectPhase seen, clock::time_point deadline,
+    ConnectProgress& progress);
+
+  static char const* phaseName(ConnectPhase phase);
+
+private:
+  void advance(ConnectProgress& progress, ConnectPhase phase, clock::time_point now);
+
+private:
+  std::mutex                        m_mutex;
+  std::condition_variable           m_changed;
+  std::map<int, ConnectProgress>    m_attempts;
+  int                               m_next_attempt;
+  std::function<bool ()>            m_has_address;
+};
+
+#endif
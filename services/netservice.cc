@@ -97,7 +97,8 @@ void
 NetService::init(cJSON const* conf, RpcNotificationFunction const& callback)
 {
   BasicRpcService::init(conf, callback);
-  registerMethod("get-interfaces", [this](cJSON const* req) -> cJSON* { return this->getInterfaces(req); });
+  registerMethod("get-interfaces", [this](cJSON const* req) -> cJSON* { return this->getInterfaces(req); },
+    RpcConcurrency::Parallel);
 }
 
 cJSON*
@@ -0,0 +1,164 @@
+//
+// Copyright [2018] [Comcast, Corp]
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#include "networkindex.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+NetworkIndex::NetworkIndex()
+  : m_mutex()
+  , m_ids()
+  , m_ssids()
+  , m_pending_adds(0)
+  , m_stale(true)
+{
+}
+
+int
+NetworkIndex::parse(std::string const& reply, std::map<int, std::string>& ssids)
+{
+  int lastId = -1;
+
+  // network id / ssid / bssid / flags
+  // 0\thome\tany\t[CURRENT]
+  size_t begin = reply.find('\n');
+  while (begin != std::string::npos && begin + 1 < reply.size())
+  {
+    begin++;
+
+    // a reply cut short at the size limit can end part way through a line,
+    // that network is listed again on the next page
+    size_t end = reply.find('\n', begin);
+    if (end == std::string::npos)
+      break;
+
+    char const* line = reply.c_str() + begin;
+    char const* tab = static_cast<char const *>(memchr(line, '\t', end - begin));
+    if (tab)
+    {
+      int id = static_cast<int>(strtol(line, nullptr, 10));
+      char const* ssidEnd = static_cast<char const *>(memchr(tab + 1, '\t', reply.c_str() + end - tab - 1));
+      if (!ssidEnd)
+        ssidEnd = reply.c_str() + end;
+
+      ssids[id] = std::string(tab + 1, ssidEnd);
+      lastId = id;
+    }
+
+    begin = end;
+  }
+
+  return lastId;
+}
+
+void
+NetworkIndex::load(std::map<int, std::string>&& ssids)
+{
+  // networks are listed by id, the first one with an ssid wins like it
+  // did when they were probed one at a time
+  std::unordered_map<std::string, int> ids;
+  for (auto const& kv : ssids)
+    ids.insert(std::make_pair(kv.second, kv.first));
+
+  std::lock_guard<std::mutex> guard(m_mutex);
+  m_ids.swap(ids);
+  m_ssids.swap(ssids);
+  m_stale = false;
+}
+
+int
+NetworkIndex::find(std::string const& ssid) const
+{
+  std::lock_guard<std::mutex> guard(m_mutex);
+  auto itr = m_ids.find(ssid);
+  return itr != m_ids.end() ? itr->second : -1;
+}
+
+void
+NetworkIndex::set(int id, std::string const& ssid)
+{
+  std::lock_guard<std::mutex> guard(m_mutex);
+  eraseId(id);
+  m_ssids[id] = ssid;
+  m_ids.insert(std::make_pair(ssid, id));
+}
+
+void
+NetworkIndex::remove(int id)
+{
+  std::lock_guard<std::mutex> guard(m_mutex);
+  eraseId(id);
+}
+
+void
+NetworkIndex::expectAdd()
+{
+  std::lock_guard<std::mutex> guard(m_mutex);
+  m_pending_adds++;
+}
+
+void
+NetworkIndex::cancelAdd()
+{
+  std::lock_guard<std::mutex> guard(m_mutex);
+  if (m_pending_adds > 0)
+    m_pending_adds--;
+}
+
+void
+NetworkIndex::added(int id)
+{
+  // the event can arrive before or after the ssid is set, so it's matched
+  // by count rather than id
+  std::lock_guard<std::mutex> guard(m_mutex);
+  if (m_pending_adds > 0)
+    m_pending_adds--;
+  else if (m_ssids.find(id) == m_ssids.end())
+    m_stale = true;
+}
+
+bool
+NetworkIndex::stale() const
+{
+  std::lock_guard<std::mutex> guard(m_mutex);
+  return m_stale;
+}
+
+void
+NetworkIndex::eraseId(int id)
+{
+  auto itr = m_ssids.find(id);
+  if (itr == m_ssids.end())
+    return;
+
+  auto ssid = m_ids.find(itr->second);
+  if (ssid != m_ids.end() && ssid->second == id)
+  {
+    m_ids.erase(ssid);
+
+    // another network with the same ssid takes its place
+    for (auto const& kv : m_ssids)
+    {
+      if (kv.first != id && kv.second == itr->second)
+      {
+        m_ids.insert(std::make_pair(kv.second, kv.first));
+        break;
+      }
+    }
+  }
+
+  m_ssids.erase(itr);
+}
@@ -0,0 +1,70 @@
+//
+// Copyright [2018] [Comcast, Corp]
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#ifndef __NETWORK_INDEX_H__
+#define __NETWORK_INDEX_H__
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// Maps the ssid of each network configured in wpa_supplicant to its network
+// id. Loaded from LIST_NETWORKS and then kept current from the service's own
+// changes and from network events, so finding a network to reuse doesn't
+// take a control request per configured network.
+class NetworkIndex
+{
+public:
+  NetworkIndex();
+
+  // adds the networks in one page of a LIST_NETWORKS reply to ssids.
+  // Returns the last id read, -1 when the page had none
+  static int parse(std::string const& reply, std::map<int, std::string>& ssids);
+
+  // replaces the index with the networks parse collected
+  void load(std::map<int, std::string>&& ssids);
+
+  // the id of the network with this ssid, -1 if there isn't one
+  int find(std::string const& ssid) const;
+
+  void set(int id, std::string const& ssid);
+  void remove(int id);
+
+  // brackets an ADD_NETWORK sent by the service, so the event for it isn't
+  // taken as someone else adding a network. cancelAdd is for when it fails
+  void expectAdd();
+  void cancelAdd();
+
+  // a network was added. Unless it was expected or its ssid is already
+  // known, the index is marked stale
+  void added(int id);
+
+  // true until the first load, and after a network has been added that
+  // may have an ssid the index doesn't know about
+  bool stale() const;
+
+private:
+  void eraseId(int id);
+
+private:
+  mutable std::mutex                    m_mutex;
+  std::unordered_map<std::string, int>  m_ids;
+  std::map<int, std::string>            m_ssids;
+  int                                   m_pending_adds;
+  bool                                  m_stale;
+};
+
+#endif
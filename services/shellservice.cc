@@ -16,14 +16,19 @@
 #include "shellservice.h"
 #include "../rpclogger.h"
 #include "../jsonrpc.h"
+#include "../reactor.h"
 
-#include <sstream>
 #include <string.h>
+#include <sys/wait.h>
 
 JSONRPC_SERVICE_DEFINE(cmd, []{return new ShellService();});
 
 namespace
 {
+  // seconds a command may run when its configuration doesn't give a
+  // "timeout"
+  int const kDefaultExecTimeout = 30;
+
   cJSON const* 
   findCommand(cJSON const* cmds, char const* method)
   {
@@ -49,31 +54,30 @@ namespace
     std::string path = JsonRpc::getStringWithExpansion(config, "/exec", true,
       nullptr, args);
 
-    XLOG_INFO("popen:%s", path.c_str());
+    XLOG_INFO("exec:%s", path.c_str());
 
-    FILE* in = popen(path.c_str(), "r");
-    if (in)
-    {
-      std::stringstream output;
+    // the child's output is collected on the reactor while this worker waits
+    std::chrono::seconds timeout(JsonRpc::getInt(config, "timeout", false,
+      kDefaultExecTimeout));
 
-      char buff[256];
-      memset(buff, 0, sizeof(buff));
-      while (fgets(buff, sizeof(buff), in))
-      {
-        output << buff;
-        memset(buff, 0, sizeof(buff));
-      }
+    int status = 0;
+    std::string out;
+    std::string err;
+    int ret = Reactor::main().runProcess(path, timeout, status, out, err);
+    if (ret == 0)
+    {
+      int code = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
 
       res = cJSON_CreateObject();
-      cJSON_AddItemToObject(res, "return_code", cJSON_CreateNumber(0));
-      cJSON_AddItemToObject(res, "stdout", cJSON_CreateString(output.str().c_str()));
-      pclose(in);
+      cJSON_AddItemToObject(res, "return_code", cJSON_CreateNumber(code));
+      cJSON_AddItemToObject(res, "stdout", cJSON_CreateString(out.c_str()));
+      if (!err.empty())
+        cJSON_AddItemToObject(res, "stderr", cJSON_CreateString(err.c_str()));
     }
     else
     {
-      int err = errno;
-      res = JsonRpc::makeError(err, "failed to execute %s. %s",
-        path.c_str(), strerror(errno));
+      res = JsonRpc::makeError(ret, "failed to execute %s. %s",
+        path.c_str(), strerror(ret));
     }
 
     return res;
@@ -93,7 +97,10 @@ void
 ShellService::init(cJSON const* conf, RpcNotificationFunction const& callback)
 {
   BasicRpcService::init(conf, callback);
-  registerMethod("exec", [this](cJSON const* req) -> cJSON* { return this->executeCommand(req); });
+  registerMethod<ExecParams>("exec",
+    [this](ExecParams const& params, cJSON const* UNUSED_PARAM(req)) -> cJSON*
+      { return this->executeCommand(params); },
+    RpcConcurrency::Parallel);
 
   cJSON const* settings = cJSON_GetObjectItem(conf, "settings");
   if (settings)
@@ -104,10 +111,19 @@ ShellService::init(cJSON const* conf, RpcNotificationFunction const& callback)
   }
 }
 
+RpcParams<ShellService::ExecParams> const&
+ShellService::ExecParams::params()
+{
+  static RpcParams<ExecParams> const p = RpcParams<ExecParams>()
+    .field("command_name", &ExecParams::CommandName, true, "name of a configured command")
+    .field("args", &ExecParams::Args, false, "values for ${name} placeholders in the command");
+  return p;
+}
+
 cJSON*
-ShellService::executeCommand(cJSON const* req)
+ShellService::executeCommand(ExecParams const& params)
 {
-  char const* commandName = JsonRpc::getString(req, "/params/command_name", true);
+  char const* commandName = params.CommandName;
 
   // TODO: req should be able to pass in command line arguments
   // ${name} should be replaced with /params/args/name's value
@@ -122,8 +138,7 @@ ShellService::executeCommand(cJSON const* req)
   }
   else
   {
-    res = invokeShellCommand(methodInfo,
-      JsonRpc::search(req, "/params/args", false));
+    res = invokeShellCommand(methodInfo, params.Args);
   }
 
   return res;
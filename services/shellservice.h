@@ -26,7 +26,14 @@ public:
   virtual ~ShellService();
   virtual void init(cJSON const* conf, RpcNotificationFunction const& callback) override;
 private:
-  cJSON* executeCommand(cJSON const* req);
+  struct ExecParams
+  {
+    char const*   CommandName;
+    cJSON const*  Args;
+    static RpcParams<ExecParams> const& params();
+  };
+
+  cJSON* executeCommand(ExecParams const& params);
   cJSON*  m_commands;
 };
 
@@ -18,632 +18,462 @@
 #include "../defs.h"
 #include "../rpclogger.h"
 #include "../jsonrpc.h"
+#include "../rpcstream.h"
 #include "../util.h"
+#include "wpainterface.h"
 
+#include <inttypes.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
-#include <unistd.h>
-#include <fcntl.h>
 
-#include <iostream>
+#include <chrono>
 #include <string>
-#include <queue>
-#include <pthread.h>
-#include <sstream>
 #include <vector>
 
-#include <wpa_ctrl.h>
 #include <cJSON.h>
 
 JSONRPC_SERVICE_DEFINE(wifi, []{return new WiFiService();});
 
-static struct wpa_ctrl* wpa_request = nullptr;
-static int wpa_shutdown_pipe[2];
-static pthread_t wpa_notify_thread;
+static int const kDefaultScanTimeout = 10;
+static int const kDefaultScanMaxAge = 30;
+static int const kDefaultConnectTimeout = 30;
+static int const kDefaultRequestConnections = 2;
 
-static cJSON* wpaControl_createResponse(std::string const& s);
-static cJSON* wpaControl_createError(int err);
-static void*  wpaControl_readNotificationSocket(void* argp);
-static void   wpaControl_reportEvent(char const* buff, int n);
-static RpcNotificationFunction responseHandler = nullptr;
-
-static cJSON* wpaControl_parseScanResult(std::string const& line);
-
-static bool ssidCompare(char const* s, char const* t)
+static void
+wpaControl_writeBss(RpcResponseStream& stream, BssEntry const& bss, BssTable::clock::time_point now)
 {
-  if (!s || !t) return false;
-  if (*s == '"') s++;
-  if (*t == '"') t++;
-  if (!s || !t) return false;
-
-  size_t n = std::min( strlen(s), strlen(t) );
-  return strncmp(s, t, n) == 0;
+  char buff[16];
+  int n = snprintf(buff, sizeof(buff), "%d", bss.Id);
+
+  stream.beginItem();
+  stream.addString("id", buff, n);
+  stream.addString("bssid", bss.Bssid.c_str(), bss.Bssid.size());
+  stream.addString("freq", bss.Freq.c_str(), bss.Freq.size());
+  stream.addString("level", bss.Level.c_str(), bss.Level.size());
+
+  long age = std::chrono::duration_cast<std::chrono::seconds>(now - bss.LastSeen).count();
+  n = snprintf(buff, sizeof(buff), "%ld", age);
+  stream.addString("age", buff, n);
+
+  stream.addString("flags", bss.Flags.c_str(), bss.Flags.size());
+  stream.addString("ssid", bss.Ssid.c_str(), bss.Ssid.size());
+  stream.endItem();
 }
 
-static bool
-ok(std::string const& s)
+WiFiService::WiFiService()
+  : BasicRpcService("wifi")
+  , m_scan_timeout(kDefaultScanTimeout)
+  , m_scan_max_age(kDefaultScanMaxAge)
+  , m_connect_timeout(kDefaultConnectTimeout)
+  , m_interfaces()
 {
-  return s == "OK";
 }
 
-int
-wpaControl_init(char const* control_socket, RpcNotificationFunction const& callback)
+WiFiService::~WiFiService()
 {
-  if (!control_socket)
-  {
-    XLOG_WARN("NULL control socket path");
-    return EINVAL;
-  }
-
-  if (!callback)
-  {
-    XLOG_WARN("NULL response callback handler");
-    return EINVAL;
-  }
-
-  responseHandler = callback;
-
-  std::string wpa_socket_name = control_socket;
-  struct wpa_ctrl* wpa_notify = nullptr;
+  for (std::unique_ptr<WpaInterface>& iface : m_interfaces)
+    iface->close();
+}
 
-  int ret = pipe2(wpa_shutdown_pipe, O_CLOEXEC);
-  if (ret == -1)
-  {
-    int err = errno;
-    XLOG_ERROR("failed to create shutdown pipe. %s", strerror(err));
-    return err;
-  }
+void
+WiFiService::init(cJSON const* conf, RpcNotificationFunction const& callback)
+{
+  BasicRpcService::init(conf, callback);
 
-  wpa_request = wpa_ctrl_open(wpa_socket_name.c_str());
-  if (!wpa_request) 
-  {
-    int err = errno;
-    XLOG_ERROR("failed to open:%s. %s", wpa_socket_name.c_str(), strerror(err));
-    return err;
-  }
-  else
-  {
-    XLOG_INFO("wpa request socket:%s opened for synchronous requests", wpa_socket_name.c_str());
-  }
+  int poolSize = JsonRpc::getInt(conf, "/settings/request-connections", false,
+    kDefaultRequestConnections);
 
-  wpa_notify = wpa_ctrl_open(wpa_socket_name.c_str());
-  if (!wpa_notify) 
+  // either one control socket in interface, or a list of them in interfaces
+  std::vector<char const*> sockets;
+  cJSON const* list = JsonRpc::search(conf, "/settings/interfaces", false);
+  if (list && cJSON_IsArray(list))
   {
-    int err = errno;
-    XLOG_ERROR("failed to open notify socket:%s. %s", wpa_socket_name.c_str(), strerror(err));
-    if (wpa_request)
+    for (cJSON const* item = list->child; item; item = item->next)
     {
-      wpa_ctrl_close(wpa_request);
-      wpa_request = nullptr;
+      if (cJSON_IsString(item))
+        sockets.push_back(item->valuestring);
     }
-    return err;
   }
   else
   {
-    XLOG_INFO("wpa request socket:%s opened for notification", wpa_socket_name.c_str());
-  }
-
-  ret = wpa_ctrl_attach(wpa_notify);
-  if (ret != 0)
-  {
-    int err = errno;
-    XLOG_WARN("failed to attach to wpa interface for notification. %s", strerror(err));
-  }
-
-  pthread_create(&wpa_notify_thread, nullptr, &wpaControl_readNotificationSocket, wpa_notify);
-  return 0;
-}
-
-void
-wpaControl_reportEvent(char const* buff, int n)
-{
-  int i;
-  int pass;
-
-  static char const* const kEventWhitelist[] =
-  {
-    WPA_EVENT_CONNECTED,
-    WPA_EVENT_DISCONNECTED,
-    NULL
-  };
-
-  i = 0;
-  pass = 0;
-
-  if (!buff || !n)
-  {
-    XLOG_INFO("null buffer or zero length string");
-    return;
+    sockets.push_back(JsonRpc::getString(conf, "/settings/interface", true));
   }
 
-  XLOG_DEBUG("event:%s", buff);
-
-  while (!pass && (kEventWhitelist[i] != NULL))
+  for (char const* path : sockets)
   {
-    // scan past the level <n>
-    // each event is prefixed with a log level type number
-    // <3>CTRL-EVENT-SCAN-RESULTS
-    char const* p  = strchr(buff, '>');
+    // the control socket is named after the interface it controls
+    char const* ifname = strrchr(path, '/');
+    ifname = ifname ? ifname + 1 : path;
+    if (sockets.size() == 1)
+      ifname = JsonRpc::getString(conf, "/settings/ifname", false, ifname);
 
-    if (p)
-      p++;
-    else
-      p = buff;
+    std::unique_ptr<WpaInterface> iface(new WpaInterface());
+    iface->open(path, ifname, poolSize, callback);
 
-    // XLOG_INFO("%s == %s (%d)", p, kEventWhitelist[i], strlen(kEventWhitelist[i]));
+    // start from what wpa_supplicant already knows, events keep it current
+    // from here on
+    iface->reloadBssTable();
+    iface->loadNetworks();
 
-    if (strncmp(kEventWhitelist[i], p, strlen(kEventWhitelist[i])) == 0)
-      pass = 1;
-    i++;
+    m_interfaces.push_back(std::move(iface));
   }
 
-  if (!pass)
-  {
-    XLOG_DEBUG("ignoring event");
-    return;
-  }
+  m_scan_timeout = JsonRpc::getInt(conf, "/settings/scan-timeout", false, kDefaultScanTimeout);
+  m_scan_max_age = JsonRpc::getInt(conf, "/settings/scan-max-age", false, kDefaultScanMaxAge);
+  m_connect_timeout = JsonRpc::getInt(conf, "/settings/connect-timeout", false, kDefaultConnectTimeout);
+
+  // scans and connects are serialized by each interface rather than the
+  // service, so different radios can be busy at the same time. They queue
+  // on the interface's strand rather than taking a worker to wait in
+  registerMethod<StatusParams>("get-status",
+    [this](StatusParams const& params, cJSON const* UNUSED_PARAM(req)) -> cJSON*
+      { return this->getStatus(params); },
+    RpcConcurrency::Parallel);
+  registerMethod<ConnectParams>("connect",
+    [this](ConnectParams const& params, cJSON const* req) -> cJSON*
+      { return this->connect(params, req); },
+    RpcConcurrency::Parallel);
+  registerMethod<ScanParams>("scan",
+    [this](ScanParams const& params, cJSON const* req) -> cJSON*
+      { return this->scan(params, req); },
+    RpcConcurrency::Parallel);
+
+  RpcStrandFunction interfaceStrand = [this](cJSON const* req) { return this->strandOf(req); };
+  setStrand("connect", interfaceStrand);
+  setStrand("scan", interfaceStrand);
+  registerMethod<CachedScanParams>("get-cached-scan",
+    [this](CachedScanParams const& params, cJSON const* req) -> cJSON*
+      { return this->getCachedScan(params, req); },
+    RpcConcurrency::Parallel);
+}
 
-  XLOG_INFO("sending event");
+static char const kInterfaceDescription[] = "network interface, the first one configured if not given";
 
-  cJSON* e = cJSON_CreateObject();
-  cJSON_AddItemToObject(e, "jsonrpc", cJSON_CreateString(kJsonRpcVersion));
-  cJSON_AddItemToObject(e, "method", cJSON_CreateString("wpa_event"));
-  cJSON_AddItemToObject(e, "params", cJSON_CreateString(buff));
-  responseHandler(e);
-  cJSON_Delete(e);
+RpcParams<WiFiService::StatusParams> const&
+WiFiService::StatusParams::params()
+{
+  static RpcParams<StatusParams> const p = RpcParams<StatusParams>()
+    .field("interface", &StatusParams::Interface, false, kInterfaceDescription)
+    .field("fields", &StatusParams::Fields, false,
+      "names from the STATUS reply to return, all of them if not given");
+  return p;
 }
 
-void*
-wpaControl_readNotificationSocket(void* argp)
+RpcParams<WiFiService::ConnectParams::Discovery> const&
+WiFiService::ConnectParams::Discovery::params()
 {
-  struct wpa_ctrl* wpa_notify = reinterpret_cast<struct wpa_ctrl *>(argp);
-
-  int wpa_fd = wpa_ctrl_get_fd(wpa_notify);
-  int shutdown_fd = wpa_shutdown_pipe[0];
-
-  int maxfd = wpa_fd;
-  if (shutdown_fd > maxfd)
-    maxfd = shutdown_fd;
-
-  XLOG_INFO("notification thread running");
-
-  bool running = true;
-  while (running)
-  {
-    fd_set readfds;
-    fd_set errfds;
-
-    FD_ZERO(&readfds);
-    FD_ZERO(&errfds);
-    FD_SET(wpa_fd, &readfds);
-    FD_SET(shutdown_fd, &readfds);
-    FD_SET(wpa_fd, &errfds);
-
-    int ret = select(maxfd + 1, &readfds, nullptr, &errfds, nullptr);
-    if (ret > 0)
-    {
-      if (FD_ISSET(shutdown_fd, &readfds))
-      {
-        running = false;
-      }
-      else if (FD_ISSET(wpa_fd, &readfds))
-      {
-        char buff[1024] = {0};
-        size_t n = sizeof(buff);
-
-        ret = wpa_ctrl_recv(wpa_notify, buff, &n);
-        if (ret < 0) 
-        {
-          XLOG_ERROR("error reading from WPA socket:%s", strerror(errno));
-        }
-        else
-        {
-          if (n < sizeof(buff))
-            buff[n] = '\0';
-          else
-            buff[sizeof(buff) - 1] = '\0';
-
-          wpaControl_reportEvent(buff, n);
-        }
-      }
-    }
-  }
-
-  wpa_ctrl_close(wpa_notify);
-  return nullptr;
+  static RpcParams<Discovery> const p = RpcParams<Discovery>()
+    .field("ssid", &Discovery::Ssid, true, "network to join");
+  return p;
 }
 
-int
-wpaControl_runCommand(char const* cmd, std::string& res, int max = 4096)
+RpcParams<WiFiService::ConnectParams::Credentials> const&
+WiFiService::ConnectParams::Credentials::params()
 {
-  res.reserve(max);
-  res.resize(max);
-
-  size_t n = res.capacity();
-
-  XLOG_INFO("wpa command:%s", cmd);
-  if (!wpa_request)
-  {
-    XLOG_ERROR("request handle is null");
-    return -EINVAL;
-  }
-
-  int ret = wpa_ctrl_request(wpa_request, cmd, strlen(cmd), &res[0], &n, nullptr);
-  if (ret < 0)
-  {
-    int err = errno;
-    XLOG_WARN("failed to submit wpa control request:%s", strerror(err));
-    return err;
-  }
-
-  res.resize(n);
-  return 0;
+  static RpcParams<Credentials> const p = RpcParams<Credentials>()
+    .field("pass", &Credentials::Pass, true, "WPA2 passphrase");
+  return p;
 }
 
-int
-wpaControl_shutdown()
+RpcParams<WiFiService::ConnectParams> const&
+WiFiService::ConnectParams::params()
 {
-  std::string s = "shutdown-now";
-  write(wpa_shutdown_pipe[1], s.c_str(), s.length());
-
-  void* retval = nullptr;
-  pthread_join(wpa_notify_thread, &retval);
-  return 0;
+  static RpcParams<ConnectParams> const p = RpcParams<ConnectParams>()
+    .field("discovery", &ConnectParams::Disc)
+    .field("cred", &ConnectParams::Cred)
+    .field("interface", &ConnectParams::Interface, false, kInterfaceDescription);
+  return p;
 }
 
-static int
-wpaControl_createNetwork(int* networkId)
+RpcParams<WiFiService::ScanParams> const&
+WiFiService::ScanParams::params()
 {
-  std::string res;
-
-  if (!networkId)
-    return EINVAL;
-
-  int ret = wpaControl_runCommand("ADD_NETWORK", res);
-  if (ret != 0)
-  {
-    int err = errno;
-    XLOG_ERROR("ADD_NETWORK failed:%s", strerror(err));
-    return err;
-  }
-
-  *networkId = static_cast<int>(strtol(res.c_str(), NULL, 10));
-
-  return 0;
+  static RpcParams<ScanParams> const p = RpcParams<ScanParams>()
+    .field("band", &ScanParams::Band, false, "frequency band to scan")
+    .field("interface", &ScanParams::Interface, false, kInterfaceDescription)
+    .field("since", &ScanParams::Since, false,
+      "generation from an earlier scan, only what changed after it is returned");
+  return p;
 }
 
-static int
-wpaControl_configureWpa2Network(int networkId, char const* ssid, char const* wpa_pass)
+RpcParams<WiFiService::CachedScanParams> const&
+WiFiService::CachedScanParams::params()
 {
-  std::string buff;
-
-  int ret;
-  char command_buff[512];
-
-  sprintf(command_buff, "SET_NETWORK %d ssid \"%s\"", networkId, ssid);
-  ret = wpaControl_runCommand(command_buff, buff);
-  if (ret < 0)
-  {
-    int err = errno;
-    XLOG_ERROR("wpaControl_connect_WPA2 set ssid failed");
-    return err;
-  }
-
-  sprintf(command_buff, "SET_NETWORK %d psk \"%s\"", networkId, wpa_pass);
-  ret = wpaControl_runCommand(command_buff, buff);
-  if (ret < 0)
-  {
-    int err = errno;
-    XLOG_ERROR("wpaControl_connect_WPA2 set psk failed");
-    return err;
-  }
-
-  XLOG_DEBUG("SET_NETWORK successful %d", networkId);
+  static RpcParams<CachedScanParams> const p = RpcParams<CachedScanParams>()
+    .field("max-age", &CachedScanParams::MaxAge, false,
+      "seconds the table may go without a scan before a new one is started")
+    .field("interface", &CachedScanParams::Interface, false, kInterfaceDescription)
+    .field("since", &CachedScanParams::Since, false,
+      "generation from an earlier scan, only what changed after it is returned");
+  return p;
+}
 
-  sprintf(command_buff, "SELECT_NETWORK %d", networkId);
-  ret = wpaControl_runCommand(command_buff, buff);
-  if (ret < 0)
-  {
-    int err = errno;
-    XLOG_ERROR("wpaControl_connect_WPA2 select network failed failed");
-    return err;
-  }
-  else
-  {
-    XLOG_DEBUG("SELECT_NETWORK successful %d", networkId);
-  }
+WpaInterface*
+WiFiService::findInterface(char const* name)
+{
+  if (m_interfaces.empty())
+    return nullptr;
+  if (!name)
+    return m_interfaces.front().get();
 
-  ret = wpaControl_runCommand("SAVE_CONFIG", buff);
-  if (ret < 0)
+  for (std::unique_ptr<WpaInterface>& iface : m_interfaces)
   {
-    int err = errno;
-    XLOG_WARN("Failed to save wpa_supplicant configuraton");
-    return err;
+    if (iface->name() == name)
+      return iface.get();
   }
-
-  return 0;
+  return nullptr;
 }
 
-
 std::string
-wpaControl_getState()
+WiFiService::strandOf(cJSON const* req) const
 {
-  std::string res;
-  wpaControl_runCommand("STATUS", res);
-
-  std::string::size_type begin = 0;
-  std::string::size_type end = 0;
-
-  while (true)
-  {
-    if (res.compare(begin, 10, "wpa_state=") == 0)
-    {
-      begin += 10;
-      return res.substr(begin, (res.find('\n', begin) - begin));
-    }
-
-    end = res.find('\n', begin + 1);
-    if (end == std::string::npos)
-      break;
-
-    begin = end + 1;
-  }
-
+  // the interface the request will be run against, without binding params
+  cJSON const* name = cJSON_GetObjectItem(paramsOf(req), "interface");
+  if (name && cJSON_IsString(name))
+    return name->valuestring;
+  if (!m_interfaces.empty())
+    return m_interfaces.front()->name();
   return std::string();
 }
 
-#if 0
-void*
-watch_wlan_state(void* UNUSED_PARAM(argp))
+cJSON*
+WiFiService::noSuchInterface(char const* name)
 {
-  bool running = true;
-  int pre_req_id = connect_req_id;
-  XLOG_DEBUG("watch_wlan_state create new thread to check state, req_id= %d", pre_req_id);
-  usleep(1000 * 1200); // wait some time then start check
-  // the state should be from "4WAY_HANDSHAKE" to something else
-  while (true)
-  {
-    if (!running || pre_req_id != connect_req_id) // ignore pre connect request thread
-    {
-      XLOG_DEBUG("watch_wlan_state thread exit req_id = %d", pre_req_id);
-      return nullptr;
-    }
-
-    std::string state = get_wlan_state();
-
-    if (!state.compare("SCANNING")
-        || !state.compare("DISCONNECTED")
-        || !state.compare("INACTIVE")
-        || !state.compare("INTERFACE_DISABLED")
-        ) // connect failed
-    {
-      cJSON* rsp = wpaControl_createAsyncConnectResponse("connect failed, maybe password wrong or something else",
-                                                         state);
-      responseHandler(rsp);
-      running = false;
-    } else if (!state.compare("COMPLETED"))
-    {
-
-      cJSON* rsp = wpaControl_createAsyncConnectResponse("connect successful", state);
-      std::string statusBuffer;
-      wpaControl_runCommand("STATUS", statusBuffer);
-      cJSON_AddItemToObject(rsp, "wlanStatus", wpaControl_createResponse(statusBuffer));
-
-      responseHandler(rsp);
-      running = false;
-    }
-    usleep(1000 * 100);  // 200 ms check
-  }
+  return JsonRpc::makeError(ENODEV, "no wifi interface %s", name ? name : "configured");
 }
-#endif
-
 
 cJSON*
-wpaControl_connectToNetwork(cJSON const* req)
+WiFiService::getStatus(StatusParams const& params)
 {
-  char* s = cJSON_Print(req);
-  if (s)
-  {
-    XLOG_INFO("connect:%s", s);
-    free(s);
-  }
-
-  char const* pass = JsonRpc::getString(req, "/params/cred/pass", true);
-  char const* ssid = JsonRpc::getString(req, "/params/discovery/ssid", true);
-
-  int ret = 0;
-  int networkId = 0;
-
-  // first list the configured networks.
-  // if one matches ssid, then simply update the password
-  int index = 0;
-  std::string buff;
-
-  do
-  {
-    char cmd[64];
-    snprintf(cmd, sizeof(cmd), "GET_NETWORK %d ssid", index);
-
-    ret = wpaControl_runCommand(cmd, buff);
-    if (ret == 0)
-    {
-      buff = chomp(buff.c_str());
-      if (ssidCompare(buff.c_str(), ssid))
-      {
-        XLOG_INFO("network '%s' already exists %d", ssid, index);
-        networkId = index;
-      }
-    }
-    else
-    {
-      // GET_NETWORK <n> SSID where n is out of bounds
-      // returns FAIL also
-      buff = "FAIL";
-    }
-    index++;
-  }
-  while ((networkId == 0) && (buff != "FAIL"));
+  WpaInterface* iface = findInterface(params.Interface);
+  if (!iface)
+    return noSuchInterface(params.Interface);
 
-  if (networkId == 0)
+  if (params.Fields)
   {
-    ret = wpaControl_createNetwork(&networkId);
-    if (ret)
-    {
-      int err = errno;
-      return JsonRpc::makeError(err, "failed to create network. %s", strerror(err));
-    }
-    XLOG_INFO("new network created, index = %d", networkId);
+    bool valid = cJSON_IsArray(params.Fields);
+    for (cJSON const* item = valid ? params.Fields->child : nullptr; item; item = item->next)
+      valid = valid && cJSON_IsString(item);
+    if (!valid)
+      return JsonRpc::makeError(kJsonRpcInvalidParams, "params/fields must be an array of strings");
   }
 
-  ret = wpaControl_configureWpa2Network(networkId, ssid, pass);
-  return cJSON_CreateString("ok");
+  return iface->getStatus(params.Fields);
 }
 
-
 cJSON*
-wpaControl_getStatus(cJSON const* UNUSED_PARAM(req))
+WiFiService::connect(ConnectParams const& params, cJSON const* req)
 {
-  std::string buff;
+  WpaInterface* iface = findInterface(params.Interface);
+  if (!iface)
+    return noSuchInterface(params.Interface);
 
-  cJSON* res = nullptr;
+  int reqId = JsonRpc::getInt(req, "id", true);
 
-  int ret = wpaControl_runCommand("STATUS", buff);
-  if (ret)
-    res = wpaControl_createError(ret);
-  else
-    res = wpaControl_createResponse(buff);
+  ConnectTracker& tracker = iface->connectTracker();
 
-  return res;
-}
+  int attempt = -1;
+  cJSON* err = iface->connectToNetwork(params.Disc.Ssid, params.Cred.Pass, &attempt);
+  if (err)
+    return err;
 
-cJSON*
-wpaControl_createResponse(std::string const& s)
-{
-  cJSON* res = nullptr;
+  ConnectTracker::clock::time_point deadline = ConnectTracker::clock::now()
+    + std::chrono::seconds(m_connect_timeout);
 
-  if (!s.empty())
+  // each phase change goes out as it happens so the client doesn't have to
+  // poll wifi-get-status
+  ConnectProgress progress;
+  ConnectPhase seen = ConnectPhase::Selecting;
+  while (tracker.wait(attempt, seen, deadline, progress))
   {
-    res = cJSON_CreateObject();
+    if (progress.Phase == seen)
+      break;  // timed out
 
-    size_t begin = 0;
-    while (true)
-    {
-      size_t end = s.find('\n', begin);
-      if (end == std::string::npos)
-        break;
+    seen = progress.Phase;
+    if (seen == ConnectPhase::Completed || seen == ConnectPhase::Failed)
+      break;
 
-      std::string line(s.substr(begin, (end - begin)));
-      size_t mid = line.find('=');
+    cJSON* status = cJSON_CreateObject();
+    cJSON_AddStringToObject(status, "status", ConnectTracker::phaseName(seen));
+    notifyProgress(reqId, status);
+  }
+  tracker.end(attempt);
 
-      if (mid != std::string::npos)
-      {
-        std::string name(line.substr(0, mid));
-        std::string value(line.substr(mid + 1));
+  ConnectTracker::clock::time_point end = ConnectTracker::clock::now();
 
-        cJSON_AddItemToObject(res, name.c_str(), cJSON_CreateString(value.c_str()));
-      }
+  // timing out after the link came up just means no address, yet
+  char const* status = ConnectTracker::phaseName(progress.Phase);
+  if (progress.Phase == ConnectPhase::Dhcp)
+    status = "connected";
+  else if (progress.Phase != ConnectPhase::Completed && progress.Phase != ConnectPhase::Failed)
+    status = "timeout";
 
-      begin = end + 1;
+  cJSON* res = cJSON_CreateObject();
+  cJSON_AddStringToObject(res, "status", status);
+  cJSON_AddNumberToObject(res, "network-id", progress.NetworkId);
+  if (progress.Phase != ConnectPhase::Completed && !progress.Reason.empty())
+    cJSON_AddStringToObject(res, "reason", progress.Reason.c_str());
+
+  // milliseconds spent in each phase that was seen
+  static ConnectPhase const kTimedPhases[] = { ConnectPhase::Selecting,
+    ConnectPhase::Associating, ConnectPhase::Handshake, ConnectPhase::Dhcp };
+
+  cJSON* timing = cJSON_CreateObject();
+  ConnectTracker::clock::time_point const never;
+  for (ConnectPhase phase : kTimedPhases)
+  {
+    ConnectTracker::clock::time_point begin = progress.Entered[static_cast<int>(phase)];
+    if (begin == never)
+      continue;
+
+    // ends when the next phase starts. A disconnect can send the attempt
+    // back to associating, so that's by time rather than phase order
+    ConnectTracker::clock::time_point until = end;
+    for (int i = 0; i < kConnectPhaseCount; ++i)
+    {
+      if (progress.Entered[i] > begin && progress.Entered[i] < until)
+        until = progress.Entered[i];
     }
+
+    cJSON_AddNumberToObject(timing, ConnectTracker::phaseName(phase),
+      std::chrono::duration_cast<std::chrono::milliseconds>(until - begin).count());
   }
+  cJSON_AddNumberToObject(timing, "total", std::chrono::duration_cast<std::chrono::milliseconds>(
+    end - progress.Entered[static_cast<int>(ConnectPhase::Selecting)]).count());
+  cJSON_AddItemToObject(res, "timing", timing);
 
   return res;
 }
 
 cJSON*
-wpaControl_createError(int err)
+WiFiService::scan(ScanParams const& params, cJSON const* req)
 {
-  char buff[256] = {0};
-  char* s = strerror_r(err, buff, sizeof(buff));
-  return JsonRpc::makeError(err, s);
-}
-
+  WpaInterface* iface = findInterface(params.Interface);
+  if (!iface)
+    return noSuchInterface(params.Interface);
 
-WiFiService::WiFiService()
-  : BasicRpcService("wifi")
-{
-}
+  int reqId = JsonRpc::getInt(req, "id", true);
 
-WiFiService::~WiFiService()
-{
-  wpaControl_shutdown();
-}
+  // taken before SCAN goes out so a results event that beats the reply
+  // isn't missed
+  uint64_t generation = iface->scanGeneration();
 
-void
-WiFiService::init(cJSON const* conf, RpcNotificationFunction const& callback)
-{
-  BasicRpcService::init(conf, callback);
+  bool started = false;
+  int ret = iface->startScan(started);
 
-  char const* iface = JsonRpc::getString(conf, "/settings/interface", true);
-  wpaControl_init(iface, callback);
+  cJSON* start = cJSON_CreateObject();
+  cJSON_AddStringToObject(start, "status", "start-scan");
+  notifyProgress(reqId, start);
 
-  registerMethod("get-status", [this](cJSON const* req) -> cJSON* { return this->getStatus(req); });
-  registerMethod("connect", [this](cJSON const* req) -> cJSON* { return this->connect(req); });
-  registerMethod("scan", [this](cJSON const* req) -> cJSON* { return this->scan(req); });
-}
+  char const* status = "scan-done";
+  if (started)
+  {
+    ret = iface->waitForScan(generation, std::chrono::seconds(m_scan_timeout));
+    if (ret == ETIMEDOUT)
+    {
+      XLOG_WARN("no scan results after %ds, returning what's cached", m_scan_timeout);
+      status = "scan-timeout";
+    }
+    else if (ret)
+    {
+      XLOG_WARN("scan failed, returning what's cached");
+      status = "scan-failed";
+    }
+  }
 
-cJSON*
-WiFiService::getStatus(cJSON const* req)
-{
-  return wpaControl_getStatus(req);
-}
+  // without a results event the table may never have been reloaded, read
+  // whatever wpa_supplicant has now
+  if (!started || ret)
+    iface->reloadBssTable();
 
-cJSON*
-WiFiService::connect(cJSON const* req)
-{
-  return wpaControl_connectToNetwork(req);
+  return writeBssTable(*iface, status, params.Since, req);
 }
 
 cJSON*
-WiFiService::scan(cJSON const* req)
+WiFiService::getCachedScan(CachedScanParams const& params, cJSON const* req)
 {
-  cJSON const* params = cJSON_GetObjectItem(req, "params");
-
-  int reqId = JsonRpc::getInt(req, "id", true);
-  char const* band = JsonRpc::getString(params, "band", false);
+  WpaInterface* iface = findInterface(params.Interface);
+  if (!iface)
+    return noSuchInterface(params.Interface);
 
-  std::string buff;
+  BssTable::clock::time_point now = BssTable::clock::now();
+  std::chrono::seconds maxAge(params.MaxAge >= 0 ? params.MaxAge : m_scan_max_age);
 
-  int ret = wpaControl_runCommand("SCAN", buff);
-  if (ret)
-  {
-    XLOG_WARN("error starting scan:%s", strerror(ret));
-  }
-  else
+  // stale data is still returned straight away, the scan started here
+  // freshens the table for the next call
+  char const* status = "cached";
+  if (now - iface->bssTable().lastReload() > maxAge)
   {
-    if (!ok(buff))
-      XLOG_WARN("error starting scan:%s", buff.c_str());
+    bool started = false;
+    iface->startScan(started);
+    if (started)
+      status = "cached-scanning";
   }
 
-  cJSON* start = cJSON_CreateObject();
-  cJSON_AddStringToObject(start, "status", "start-scan");
-  notifyAndDelete(JsonRpc::wrapResponse(0, start, reqId));
+  return writeBssTable(*iface, status, params.Since, req);
+}
 
-  int id = 0;
-  while (true)
+cJSON*
+WiFiService::writeBssTable(WpaInterface& iface, char const* status, char const* since,
+  cJSON const* req)
+{
+  BssTable& table = iface.bssTable();
+
+  BssTable::clock::time_point now = BssTable::clock::now();
+
+  // the generation goes out as an opaque hex token, it doesn't fit in a
+  // JSON number a client is guaranteed to keep exactly
+  uint64_t from = 0;
+  if (since)
+    from = strtoull(since, nullptr, 16);
+
+  // copied out of the table so the lock isn't held while waiting on the
+  // client
+  bool full = true;
+  std::vector<BssEntry> entries;
+  std::vector<BssTombstone> removed;
+  uint64_t generation = table.delta(from, entries, removed, full);
+
+  char token[32];
+  snprintf(token, sizeof(token), "%" PRIx64, generation);
+
+  cJSON* head = cJSON_CreateObject();
+  cJSON_AddStringToObject(head, "status", status);
+  cJSON_AddNumberToObject(head, "age",
+    std::chrono::duration_cast<std::chrono::seconds>(now - table.lastReload()).count());
+  if (since)
   {
-    char cmd[16];
-    snprintf(cmd, sizeof(cmd), "BSS %d", id);
+    cJSON_AddBoolToObject(head, "full", full);
 
-    buff.resize(0);
-    ret = wpaControl_runCommand(cmd,  buff, 8192);
-    if (!ret)
+    cJSON* ids = cJSON_CreateArray();
+    for (BssTombstone const& t : removed)
     {
-      cJSON* bss = wpaControl_createResponse(buff);
-      if (bss)
-        notifyAndDelete(JsonRpc::wrapResponse(0, bss, reqId));
+      char buff[16];
+      snprintf(buff, sizeof(buff), "%d", t.Id);
+      cJSON_AddItemToArray(ids, cJSON_CreateString(buff));
     }
+    cJSON_AddItemToObject(head, "removed", ids);
+  }
 
-    id++;
+  std::unique_ptr<RpcResponseStream> stream = openResponseStream(req);
+  stream->begin(head, "results");
+  cJSON_Delete(head);
 
-    if (buff.size() == 0)
+  for (BssEntry const& bss : entries)
+  {
+    if (stream->stalled())
       break;
+    wpaControl_writeBss(*stream, bss, now);
   }
 
-  cJSON* res = cJSON_CreateObject();
-  cJSON_AddStringToObject(res, "status", "scan-done");
+  // a client that stalled is missing entries, it mustn't be handed a token
+  // that says it has everything up to this generation
+  cJSON* tail = cJSON_CreateObject();
+  cJSON_AddStringToObject(tail, "generation", token);
+  cJSON* res = stream->finish(tail);
+  cJSON_Delete(tail);
   return res;
 }
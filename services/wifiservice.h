@@ -19,6 +19,11 @@
 #include "../defs.h"
 #include "../rpcserver.h"
 
+#include <memory>
+#include <vector>
+
+class WpaInterface;
+
 class WiFiService : public BasicRpcService
 {
 public:
@@ -26,9 +31,83 @@ public:
   virtual ~WiFiService();
   virtual void init(cJSON const* conf, RpcNotificationFunction const& callback) override;
 private:
-  cJSON* getStatus(cJSON const* req);
-  cJSON* connect(cJSON const* req);
-  cJSON* scan(cJSON const* req);
+  struct StatusParams
+  {
+    char const* Interface;
+    cJSON const* Fields;
+    static RpcParams<StatusParams> const& params();
+  };
+
+  struct ConnectParams
+  {
+    struct Discovery
+    {
+      char const* Ssid;
+      static RpcParams<Discovery> const& params();
+    };
+
+    struct Credentials
+    {
+      char const* Pass;
+      static RpcParams<Credentials> const& params();
+    };
+
+    Discovery   Disc;
+    Credentials Cred;
+    char const* Interface;
+    static RpcParams<ConnectParams> const& params();
+  };
+
+  struct ScanParams
+  {
+    ScanParams()
+      : Band(nullptr)
+      , Since(nullptr)
+      , Interface(nullptr) { }
+    char const* Band;
+    char const* Since;
+    char const* Interface;
+    static RpcParams<ScanParams> const& params();
+  };
+
+  struct CachedScanParams
+  {
+    CachedScanParams()
+      : MaxAge(-1)
+      , Since(nullptr)
+      , Interface(nullptr) { }
+    int MaxAge;
+    char const* Since;
+    char const* Interface;
+    static RpcParams<CachedScanParams> const& params();
+  };
+
+  // the interface named, or the first one when name is null
+  WpaInterface* findInterface(char const* name);
+  cJSON* noSuchInterface(char const* name);
+
+  // the strand scans and connects run on, one per interface
+  std::string strandOf(cJSON const* req) const;
+
+  cJSON* getStatus(StatusParams const& params);
+  cJSON* connect(ConnectParams const& params, cJSON const* req);
+  cJSON* scan(ScanParams const& params, cJSON const* req);
+  cJSON* getCachedScan(CachedScanParams const& params, cJSON const* req);
+  cJSON* writeBssTable(WpaInterface& iface, char const* status, char const* since,
+    cJSON const* req);
+
+private:
+  // seconds a scan waits for wpa_supplicant to report results
+  int m_scan_timeout;
+
+  // seconds the BSS table can go without a scan before get-cached-scan
+  // starts one
+  int m_scan_max_age;
+
+  // seconds a connect waits to get an address before returning
+  int m_connect_timeout;
+
+  std::vector< std::unique_ptr<WpaInterface> > m_interfaces;
 };
 
 #endif
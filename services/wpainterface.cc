@@ -0,0 +1,764 @@
+//
+// Copyright [2018] [Comcast, Corp]
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#include "wpainterface.h"
+#include "wpareply.h"
+
+#include "../defs.h"
+#include "../rpclogger.h"
+#include "../jsonrpc.h"
+#include "../reactor.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ifaddrs.h>
+#include <unistd.h>
+#include <net/if.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+
+#include <wpa_ctrl.h>
+#include <cJSON.h>
+
+static cJSON* wpaControl_createError(int err);
+
+static bool
+ok(std::string const& s)
+{
+  // replies come back with a trailing newline
+  return s.compare(0, 2, "OK") == 0;
+}
+
+static bool
+startsWith(char const* s, char const* prefix)
+{
+  return strncmp(s, prefix, strlen(prefix)) == 0;
+}
+
+// the fields wifi-scan reports for each BSS, one entry per line and each
+// entry closed with ====
+static unsigned int const kBssMask = WPA_BSS_MASK_ID | WPA_BSS_MASK_BSSID | WPA_BSS_MASK_FREQ |
+  WPA_BSS_MASK_LEVEL | WPA_BSS_MASK_AGE | WPA_BSS_MASK_FLAGS | WPA_BSS_MASK_SSID |
+  WPA_BSS_MASK_DELIM;
+
+// wpa_supplicant fills its reply with as many entries as fit, which is
+// usually 4K, so larger scans take another request starting after the last
+// id returned
+static int const kBssReplySize = 16384;
+static int const kListNetworksReplySize = 16384;
+
+WpaInterface::WpaInterface()
+  : m_name()
+  , m_notify(nullptr)
+  , m_pool_mutex()
+  , m_pool_available()
+  , m_pool()
+  , m_idle()
+  , m_events(nullptr)
+  , m_events_fd(-1)
+  , m_scan_mutex()
+  , m_scan_event()
+  , m_scan_generation(0)
+  , m_scan_failed(false)
+  , m_scan_work()
+  , m_scan_pending(false)
+  , m_scan_pending_failed(false)
+  , m_scan_stop(false)
+  , m_scan_thread()
+  , m_bss_table()
+  , m_network_index()
+  , m_connect_tracker()
+  , m_address_fd(-1)
+  , m_ifname()
+  , m_ifindex(0)
+{
+}
+
+WpaInterface::~WpaInterface()
+{
+  close();
+}
+
+int
+WpaInterface::open(char const* controlSocket, char const* ifname, int poolSize,
+  RpcNotificationFunction const& notify)
+{
+  if (!controlSocket)
+  {
+    XLOG_WARN("NULL control socket path");
+    return EINVAL;
+  }
+
+  if (!notify)
+  {
+    XLOG_WARN("NULL response callback handler");
+    return EINVAL;
+  }
+
+  m_name = ifname;
+  m_notify = notify;
+
+  for (int i = 0; i < poolSize; ++i)
+  {
+    struct wpa_ctrl* ctrl = wpa_ctrl_open(controlSocket);
+    if (!ctrl)
+    {
+      int err = errno;
+      XLOG_ERROR("failed to open:%s. %s", controlSocket, strerror(err));
+      close();
+      return err;
+    }
+    m_pool.push_back(ctrl);
+  }
+  m_idle = m_pool;
+  XLOG_INFO("wpa request socket:%s opened %d times for synchronous requests", controlSocket,
+    poolSize);
+
+  m_events = wpa_ctrl_open(controlSocket);
+  if (!m_events)
+  {
+    int err = errno;
+    XLOG_ERROR("failed to open notify socket:%s. %s", controlSocket, strerror(err));
+    close();
+    return err;
+  }
+  else
+  {
+    XLOG_INFO("wpa request socket:%s opened for notification", controlSocket);
+  }
+
+  int ret = wpa_ctrl_attach(m_events);
+  if (ret != 0)
+  {
+    int err = errno;
+    XLOG_WARN("failed to attach to wpa interface for notification. %s", strerror(err));
+  }
+
+  // events are read on the reactor, which mustn't block on the pool. A scan
+  // finishing is handed to a thread that reloads the BSS table instead
+  m_scan_stop = false;
+  m_scan_thread = std::thread(&WpaInterface::processScans, this);
+
+  int fd = wpa_ctrl_get_fd(m_events);
+  ret = Reactor::main().addFd(fd, EPOLLIN, "wpa-events", [this](uint32_t) { readNotification(); });
+  if (ret)
+  {
+    XLOG_ERROR("failed to watch notify socket:%s. %s", controlSocket, strerror(ret));
+    close();
+    return ret;
+  }
+  m_events_fd = fd;
+
+  if (openAddressMonitor(ifname) == 0)
+  {
+    ret = Reactor::main().addFd(m_address_fd, EPOLLIN, "netlink-address",
+      [this](uint32_t) { readAddressEvents(); });
+    if (ret)
+    {
+      ::close(m_address_fd);
+      m_address_fd = -1;
+    }
+    else
+    {
+      m_connect_tracker.setAddressCheck([this] { return hasAddress(); });
+    }
+  }
+
+  return 0;
+}
+
+void
+WpaInterface::close()
+{
+  // removing a source waits out a handler that's already running, so
+  // nothing is reading the sockets once they're closed below
+  if (m_events_fd != -1)
+  {
+    Reactor::main().removeFd(m_events_fd);
+    m_events_fd = -1;
+  }
+
+  if (m_address_fd != -1)
+    Reactor::main().removeFd(m_address_fd);
+
+  if (m_scan_thread.joinable())
+  {
+    {
+      std::lock_guard<std::mutex> guard(m_scan_mutex);
+      m_scan_stop = true;
+    }
+    m_scan_work.notify_all();
+    m_scan_thread.join();
+  }
+
+  if (m_events)
+  {
+    wpa_ctrl_close(m_events);
+    m_events = nullptr;
+  }
+
+  {
+    std::lock_guard<std::mutex> guard(m_pool_mutex);
+    for (struct wpa_ctrl* ctrl : m_pool)
+      wpa_ctrl_close(ctrl);
+    m_pool.clear();
+    m_idle.clear();
+  }
+
+  if (m_address_fd != -1)
+  {
+    ::close(m_address_fd);
+    m_address_fd = -1;
+  }
+}
+
+struct wpa_ctrl*
+WpaInterface::acquire()
+{
+  std::unique_lock<std::mutex> lock(m_pool_mutex);
+  if (m_pool.empty())
+    return nullptr;
+
+  m_pool_available.wait(lock, [this] { return !m_idle.empty(); });
+
+  struct wpa_ctrl* ctrl = m_idle.back();
+  m_idle.pop_back();
+  return ctrl;
+}
+
+void
+WpaInterface::release(struct wpa_ctrl* ctrl)
+{
+  {
+    std::lock_guard<std::mutex> guard(m_pool_mutex);
+    m_idle.push_back(ctrl);
+  }
+  m_pool_available.notify_one();
+}
+
+int
+WpaInterface::runCommand(char const* cmd, std::string& res, int max)
+{
+  res.reserve(max);
+  res.resize(max);
+
+  size_t n = res.capacity();
+
+  XLOG_INFO("wpa command[%s]:%s", m_name.c_str(), cmd);
+
+  struct wpa_ctrl* ctrl = acquire();
+  if (!ctrl)
+  {
+    XLOG_ERROR("request handle is null");
+    return EINVAL;
+  }
+
+  int err = 0;
+  int ret = wpa_ctrl_request(ctrl, cmd, strlen(cmd), &res[0], &n, nullptr);
+  if (ret < 0)
+    err = errno;
+
+  release(ctrl);
+
+  if (ret < 0)
+  {
+    XLOG_WARN("failed to submit wpa control request:%s", strerror(err));
+    return err;
+  }
+
+  res.resize(n);
+  return 0;
+}
+
+int
+WpaInterface::startScan(bool& started)
+{
+  std::string buff;
+
+  started = false;
+  int ret = runCommand("SCAN", buff);
+  if (ret)
+    XLOG_WARN("error starting scan:%s", strerror(ret));
+  else if (ok(buff) || startsWith(buff.c_str(), "FAIL-BUSY"))
+    started = true;  // when busy, the scan already running is just as good
+  else
+    XLOG_WARN("error starting scan:%s", buff.c_str());
+
+  return ret;
+}
+
+uint64_t
+WpaInterface::scanGeneration()
+{
+  std::lock_guard<std::mutex> guard(m_scan_mutex);
+  return m_scan_generation;
+}
+
+int
+WpaInterface::waitForScan(uint64_t generation, std::chrono::seconds timeout)
+{
+  std::unique_lock<std::mutex> guard(m_scan_mutex);
+  if (!m_scan_event.wait_for(guard, timeout, [this, generation] { return m_scan_generation != generation; }))
+    return ETIMEDOUT;
+  return m_scan_failed ? EIO : 0;
+}
+
+void
+WpaInterface::processScans()
+{
+  std::unique_lock<std::mutex> guard(m_scan_mutex);
+  while (true)
+  {
+    m_scan_work.wait(guard, [this] { return m_scan_pending || m_scan_stop; });
+    if (m_scan_stop)
+      break;
+
+    // events that arrive while the table is loading are folded into one
+    // more pass, whatever the last of them said is what waiters see
+    bool failed = m_scan_pending_failed;
+    m_scan_pending = false;
+    guard.unlock();
+
+    // reloaded before waking anyone so a finished scan reads the new list
+    if (!failed)
+      reloadBssTable();
+
+    guard.lock();
+    m_scan_generation++;
+    m_scan_failed = failed;
+    m_scan_event.notify_all();
+  }
+}
+
+void
+WpaInterface::readNotification()
+{
+  char buff[1024] = {0};
+  size_t n = sizeof(buff);
+
+  int ret = wpa_ctrl_recv(m_events, buff, &n);
+  if (ret < 0)
+  {
+    XLOG_ERROR("error reading from WPA socket:%s", strerror(errno));
+    return;
+  }
+
+  if (n < sizeof(buff))
+    buff[n] = '\0';
+  else
+    buff[sizeof(buff) - 1] = '\0';
+
+  reportEvent(buff, n);
+}
+
+void
+WpaInterface::reportEvent(char const* buff, int n)
+{
+  int i;
+  int pass;
+
+  static char const* const kEventWhitelist[] =
+  {
+    WPA_EVENT_CONNECTED,
+    WPA_EVENT_DISCONNECTED,
+    NULL
+  };
+
+  i = 0;
+  pass = 0;
+
+  if (!buff || !n)
+  {
+    XLOG_INFO("null buffer or zero length string");
+    return;
+  }
+
+  XLOG_DEBUG("event[%s]:%s", m_name.c_str(), buff);
+
+  // scan past the level <n>
+  // each event is prefixed with a log level type number
+  // <3>CTRL-EVENT-SCAN-RESULTS
+  char const* p  = strchr(buff, '>');
+
+  if (p)
+    p++;
+  else
+    p = buff;
+
+  m_connect_tracker.onEvent(p);
+
+  if (startsWith(p, WPA_EVENT_NETWORK_ADDED))
+    m_network_index.added(atoi(p + strlen(WPA_EVENT_NETWORK_ADDED)));
+  else if (startsWith(p, WPA_EVENT_NETWORK_REMOVED))
+    m_network_index.remove(atoi(p + strlen(WPA_EVENT_NETWORK_REMOVED)));
+
+  if (startsWith(p, WPA_EVENT_BSS_ADDED) || startsWith(p, WPA_EVENT_BSS_REMOVED))
+  {
+    // CTRL-EVENT-BSS-ADDED <id> <bssid>
+    bool added = startsWith(p, WPA_EVENT_BSS_ADDED);
+    char* end = nullptr;
+    char const* args = p + strlen(added ? WPA_EVENT_BSS_ADDED : WPA_EVENT_BSS_REMOVED);
+    int id = static_cast<int>(strtol(args, &end, 10));
+    if (end != args)
+    {
+      if (added)
+        m_bss_table.add(id, chomp(end + strspn(end, " ")));
+      else
+        m_bss_table.remove(id);
+    }
+  }
+
+  bool scanResults = startsWith(p, WPA_EVENT_SCAN_RESULTS);
+  if (scanResults || startsWith(p, WPA_EVENT_SCAN_FAILED))
+  {
+    {
+      std::lock_guard<std::mutex> guard(m_scan_mutex);
+      m_scan_pending = true;
+      m_scan_pending_failed = !scanResults;
+    }
+    m_scan_work.notify_one();
+  }
+
+  while (!pass && (kEventWhitelist[i] != NULL))
+  {
+    // XLOG_INFO("%s == %s (%d)", p, kEventWhitelist[i], strlen(kEventWhitelist[i]));
+
+    if (strncmp(kEventWhitelist[i], p, strlen(kEventWhitelist[i])) == 0)
+      pass = 1;
+    i++;
+  }
+
+  if (!pass)
+  {
+    XLOG_DEBUG("ignoring event");
+    return;
+  }
+
+  XLOG_INFO("sending event");
+
+  cJSON* params = cJSON_CreateObject();
+  cJSON_AddStringToObject(params, "interface", m_name.c_str());
+  cJSON_AddStringToObject(params, "event", buff);
+
+  cJSON* e = cJSON_CreateObject();
+  cJSON_AddItemToObject(e, "jsonrpc", cJSON_CreateString(kJsonRpcVersion));
+  cJSON_AddItemToObject(e, "method", cJSON_CreateString("wpa_event"));
+  cJSON_AddItemToObject(e, "params", params);
+  m_notify(e);
+  cJSON_Delete(e);
+}
+
+// listens for IPv4 addresses being added to ifname, which is how a connect
+// knows DHCP is done
+int
+WpaInterface::openAddressMonitor(char const* ifname)
+{
+  m_ifname = ifname;
+  m_ifindex = if_nametoindex(ifname);
+  if (m_ifindex == 0)
+  {
+    int err = errno;
+    XLOG_WARN("no interface %s, connect won't wait for an address. %s", ifname, strerror(err));
+    return err;
+  }
+
+  int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC | SOCK_NONBLOCK, NETLINK_ROUTE);
+  if (fd == -1)
+  {
+    int err = errno;
+    XLOG_ERROR("failed to create netlink socket. %s", strerror(err));
+    return err;
+  }
+
+  struct sockaddr_nl addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.nl_family = AF_NETLINK;
+  addr.nl_groups = RTMGRP_IPV4_IFADDR;
+
+  int ret = bind(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr));
+  if (ret == -1)
+  {
+    int err = errno;
+    XLOG_ERROR("failed to bind netlink socket. %s", strerror(err));
+    ::close(fd);
+    return err;
+  }
+
+  m_address_fd = fd;
+  return 0;
+}
+
+bool
+WpaInterface::hasAddress() const
+{
+  struct ifaddrs* addrs = nullptr;
+  if (getifaddrs(&addrs) == -1)
+  {
+    XLOG_WARN("failed to get addresses of %s. %s", m_ifname.c_str(), strerror(errno));
+    return false;
+  }
+
+  bool found = false;
+  for (struct ifaddrs* ifa = addrs; ifa && !found; ifa = ifa->ifa_next)
+  {
+    found = ifa->ifa_addr && ifa->ifa_addr->sa_family == AF_INET &&
+      m_ifname == ifa->ifa_name;
+  }
+
+  freeifaddrs(addrs);
+  return found;
+}
+
+void
+WpaInterface::readAddressEvents()
+{
+  char buff[4096];
+  while (true)
+  {
+    ssize_t n = recv(m_address_fd, buff, sizeof(buff), 0);
+    if (n <= 0)
+    {
+      if (n == -1 && errno != EAGAIN && errno != EWOULDBLOCK)
+        XLOG_ERROR("error reading netlink socket:%s", strerror(errno));
+      return;
+    }
+
+    int len = static_cast<int>(n);
+    for (struct nlmsghdr* msg = reinterpret_cast<struct nlmsghdr *>(buff); NLMSG_OK(msg, len);
+      msg = NLMSG_NEXT(msg, len))
+    {
+      if (msg->nlmsg_type != RTM_NEWADDR)
+        continue;
+
+      struct ifaddrmsg* ifa = reinterpret_cast<struct ifaddrmsg *>(NLMSG_DATA(msg));
+      if (ifa->ifa_index == m_ifindex && ifa->ifa_family == AF_INET)
+      {
+        XLOG_INFO("address added to %s", m_name.c_str());
+        m_connect_tracker.onAddressAdded();
+      }
+    }
+  }
+}
+
+int
+WpaInterface::runOkCommand(char const* cmd, char const* what)
+{
+  std::string buff;
+
+  int ret = runCommand(cmd, buff);
+  if (ret != 0)
+  {
+    XLOG_ERROR("failed to %s. %s", what, strerror(ret));
+    return ret;
+  }
+
+  if (!ok(buff))
+  {
+    XLOG_ERROR("failed to %s. %s", what, chomp(buff.c_str()).c_str());
+    return EIO;
+  }
+
+  return 0;
+}
+
+int
+WpaInterface::createNetwork(int* networkId)
+{
+  std::string res;
+
+  if (!networkId)
+    return EINVAL;
+
+  m_network_index.expectAdd();
+
+  int ret = runCommand("ADD_NETWORK", res);
+  if (ret == 0 && startsWith(res.c_str(), "FAIL"))
+    ret = EIO;
+
+  if (ret != 0)
+  {
+    m_network_index.cancelAdd();
+    XLOG_ERROR("ADD_NETWORK failed:%s", strerror(ret));
+    return ret;
+  }
+
+  *networkId = static_cast<int>(strtol(res.c_str(), NULL, 10));
+
+  return 0;
+}
+
+int
+WpaInterface::configureWpa2Network(int networkId, char const* ssid, char const* wpa_pass)
+{
+  int ret;
+  char command_buff[512];
+
+  snprintf(command_buff, sizeof(command_buff), "SET_NETWORK %d ssid \"%s\"", networkId, ssid);
+  ret = runOkCommand(command_buff, "set ssid");
+  if (ret != 0)
+    return ret;
+  m_network_index.set(networkId, ssid);
+
+  snprintf(command_buff, sizeof(command_buff), "SET_NETWORK %d psk \"%s\"", networkId, wpa_pass);
+  ret = runOkCommand(command_buff, "set psk");
+  if (ret != 0)
+    return ret;
+
+  XLOG_DEBUG("SET_NETWORK successful %d", networkId);
+
+  snprintf(command_buff, sizeof(command_buff), "SELECT_NETWORK %d", networkId);
+  ret = runOkCommand(command_buff, "select network");
+  if (ret != 0)
+    return ret;
+
+  XLOG_DEBUG("SELECT_NETWORK successful %d", networkId);
+
+  ret = runOkCommand("SAVE_CONFIG", "save wpa_supplicant configuration");
+  if (ret != 0)
+    return ret;
+
+  return 0;
+}
+
+cJSON*
+WpaInterface::connectToNetwork(char const* ssid, char const* pass, int* attempt)
+{
+  XLOG_INFO("connect ssid:%s on %s", ssid, m_name.c_str());
+
+  int ret = 0;
+
+  // if a configured network matches ssid, then simply update the password
+  if (m_network_index.stale())
+    loadNetworks();
+
+  int networkId = m_network_index.find(ssid);
+  if (networkId != -1)
+    XLOG_INFO("network '%s' already exists %d", ssid, networkId);
+
+  if (networkId == -1)
+  {
+    ret = createNetwork(&networkId);
+    if (ret)
+      return JsonRpc::makeError(ret, "failed to create network. %s", strerror(ret));
+    XLOG_INFO("new network created, index = %d", networkId);
+  }
+
+  // tracked from before SELECT_NETWORK so no event is missed
+  *attempt = m_connect_tracker.begin(networkId);
+
+  ret = configureWpa2Network(networkId, ssid, pass);
+  if (ret)
+  {
+    m_connect_tracker.end(*attempt);
+    return JsonRpc::makeError(ret, "failed to configure network. %s", strerror(ret));
+  }
+
+  return nullptr;
+}
+
+cJSON*
+WpaInterface::getStatus(cJSON const* fields)
+{
+  std::string buff;
+
+  cJSON* res = nullptr;
+
+  int ret = runCommand("STATUS", buff);
+  if (ret)
+    res = wpaControl_createError(ret);
+  else
+    res = WpaReply::toJson(buff, fields);
+
+  return res;
+}
+
+int
+WpaInterface::reloadBssTable()
+{
+  std::vector<BssEntry> entries;
+  std::string buff;
+  BssTable::clock::time_point now = BssTable::clock::now();
+
+  int next = 0;
+  while (true)
+  {
+    char cmd[64];
+    snprintf(cmd, sizeof(cmd), "BSS RANGE=%d- MASK=0x%x", next, kBssMask);
+
+    int ret = runCommand(cmd, buff, kBssReplySize);
+    if (ret)
+      return ret;
+    if (buff.empty())
+      break;
+
+    int last = BssTable::parse(buff, now, entries);
+    if (last < next)
+      break;
+
+    next = last + 1;
+  }
+
+  XLOG_INFO("bss table for %s reloaded, %zu entries", m_name.c_str(), entries.size());
+  m_bss_table.reload(std::move(entries), now);
+  return 0;
+}
+
+int
+WpaInterface::loadNetworks()
+{
+  std::map<int, std::string> ssids;
+  std::string buff;
+
+  // like BSS RANGE the reply is cut off at wpa_supplicant's buffer size, so
+  // it's paged until one comes back without any networks
+  int last = -1;
+  while (true)
+  {
+    char cmd[64];
+    if (last == -1)
+      snprintf(cmd, sizeof(cmd), "LIST_NETWORKS");
+    else
+      snprintf(cmd, sizeof(cmd), "LIST_NETWORKS LAST_ID=%d", last);
+
+    int ret = runCommand(cmd, buff, kListNetworksReplySize);
+    if (ret)
+    {
+      XLOG_WARN("failed to list networks:%s", strerror(ret));
+      return ret;
+    }
+
+    int id = NetworkIndex::parse(buff, ssids);
+    if (id <= last)
+      break;
+
+    last = id;
+  }
+
+  XLOG_INFO("network index for %s loaded, %zu networks", m_name.c_str(), ssids.size());
+  m_network_index.load(std::move(ssids));
+  return 0;
+}
+
+cJSON*
+wpaControl_createError(int err)
+{
+  char buff[256] = {0};
+  char* s = strerror_r(err, buff, sizeof(buff));
+  return JsonRpc::makeError(err, s);
+}
@@ -0,0 +1,135 @@
+//
+// Copyright [2018] [Comcast, Corp]
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#ifndef __WPA_INTERFACE_H__
+#define __WPA_INTERFACE_H__
+
+#include "../rpcserver.h"
+#include "bsstable.h"
+#include "connecttracker.h"
+#include "networkindex.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct wpa_ctrl;
+
+// One radio managed through wpa_supplicant. Requests go over a small pool of
+// control connections so a status query doesn't wait behind a scan being
+// paged in, and events come in on a connection of their own that's read on
+// the main reactor. Everything the wifi service knows about the radio lives
+// here, so each interface is independent of the others.
+class WpaInterface
+{
+public:
+  WpaInterface();
+  ~WpaInterface();
+
+  // opens poolSize request connections and the event connection to the
+  // control socket. ifname is the network interface watched for addresses
+  int open(char const* controlSocket, char const* ifname, int poolSize,
+    RpcNotificationFunction const& notify);
+  void close();
+
+  std::string const& name() const
+    { return m_name; }
+
+  int runCommand(char const* cmd, std::string& res, int max = 4096);
+
+  // sends SCAN. started is set when a scan is running afterwards, which
+  // includes one that already was
+  int startScan(bool& started);
+
+  uint64_t scanGeneration();
+
+  // waits for the first scan to finish after generation. Returns 0 when it
+  // completed, ETIMEDOUT or EIO when it failed
+  int waitForScan(uint64_t generation, std::chrono::seconds timeout);
+
+  int reloadBssTable();
+  int loadNetworks();
+
+  // the STATUS reply as an object, only the names in fields when it's given
+  cJSON* getStatus(cJSON const* fields = nullptr);
+
+  // returns nullptr once SELECT_NETWORK has been sent and attempt is being
+  // tracked, an error otherwise
+  cJSON* connectToNetwork(char const* ssid, char const* pass, int* attempt);
+
+  BssTable& bssTable()
+    { return m_bss_table; }
+  ConnectTracker& connectTracker()
+    { return m_connect_tracker; }
+
+private:
+  struct wpa_ctrl* acquire();
+  void release(struct wpa_ctrl* ctrl);
+  int openAddressMonitor(char const* ifname);
+  bool hasAddress() const;
+  void readNotification();
+  void readAddressEvents();
+  void reportEvent(char const* buff, int n);
+  void processScans();
+  // runs cmd and treats any reply but OK as a failure, EIO when it's FAIL
+  int runOkCommand(char const* cmd, char const* what);
+  int createNetwork(int* networkId);
+  int configureWpa2Network(int networkId, char const* ssid, char const* wpa_pass);
+
+private:
+  std::string                     m_name;
+  RpcNotificationFunction         m_notify;
+
+  // request connections not currently in use. wpa_ctrl_request isn't safe
+  // on one handle from more than one thread, so each request takes its own
+  std::mutex                      m_pool_mutex;
+  std::condition_variable         m_pool_available;
+  std::vector<struct wpa_ctrl *>  m_pool;
+  std::vector<struct wpa_ctrl *>  m_idle;
+
+  struct wpa_ctrl*                m_events;
+  int                             m_events_fd;
+
+  // bumped each time wpa_supplicant reports that a scan finished or
+  // failed, once the BSS table has been reloaded. A scan waits for it to
+  // move past the value it had when the scan was requested
+  std::mutex                      m_scan_mutex;
+  std::condition_variable         m_scan_event;
+  uint64_t                        m_scan_generation;
+  bool                            m_scan_failed;
+
+  // the reactor posts scan events here for m_scan_thread, which does the
+  // requests a reload takes
+  std::condition_variable         m_scan_work;
+  bool                            m_scan_pending;
+  bool                            m_scan_pending_failed;
+  bool                            m_scan_stop;
+  std::thread                     m_scan_thread;
+
+  BssTable                        m_bss_table;
+  NetworkIndex                    m_network_index;
+
+  // fed by wpa_supplicant events and by netlink address notifications
+  ConnectTracker                  m_connect_tracker;
+  int                             m_address_fd;
+  std::string                     m_ifname;
+  unsigned int                    m_ifindex;
+};
+
+#endif
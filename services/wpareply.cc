@@ -0,0 +1,131 @@
+//
+// Copyright [2018] [Comcast, Corp]
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#include "wpareply.h"
+
+#include <cJSON.h>
+
+namespace
+{
+  bool
+  isRequested(cJSON const* fields, WpaReplyField const& field)
+  {
+    for (cJSON const* item = fields->child; item; item = item->next)
+    {
+      if (cJSON_IsString(item) && strcmp(item->valuestring, field.Name) == 0)
+        return true;
+    }
+    return false;
+  }
+}
+
+long
+WpaReplyField::toLong() const
+{
+  char const* p = Value;
+  char const* end = Value + ValueLength;
+  if (!p || p == end)
+    return 0;
+
+  bool negative = *p == '-';
+  if (negative)
+    ++p;
+
+  long n = 0;
+  for (; p < end && *p >= '0' && *p <= '9'; ++p)
+    n = n * 10 + (*p - '0');
+
+  return negative ? -n : n;
+}
+
+WpaReply::WpaReply(char* reply, size_t n)
+  : m_pos(reply)
+  , m_end(reply + n)
+{
+}
+
+WpaReply::WpaReply(std::string& reply)
+  : m_pos(&reply[0])
+  , m_end(&reply[0] + reply.size())
+{
+}
+
+bool
+WpaReply::next(WpaReplyField& field)
+{
+  if (m_pos >= m_end)
+    return false;
+
+  char* line = m_pos;
+  char* eol = static_cast<char *>(memchr(line, '\n', m_end - line));
+  if (eol)
+  {
+    *eol = '\0';
+    m_pos = eol + 1;
+  }
+  else
+  {
+    // the last line isn't always closed with a newline, the buffer's own
+    // terminator ends it instead
+    eol = m_end;
+    m_pos = m_end;
+  }
+
+  char* mid = static_cast<char *>(memchr(line, '=', eol - line));
+
+  field.Name = line;
+  if (mid)
+  {
+    *mid = '\0';
+    field.NameLength = mid - line;
+    field.Value = mid + 1;
+    field.ValueLength = eol - (mid + 1);
+  }
+  else
+  {
+    field.NameLength = eol - line;
+    field.Value = nullptr;
+    field.ValueLength = 0;
+  }
+
+  return true;
+}
+
+cJSON*
+WpaReply::toJson(std::string& reply, cJSON const* fields)
+{
+  if (reply.empty())
+    return nullptr;
+
+  int wanted = fields ? cJSON_GetArraySize(fields) : -1;
+
+  cJSON* res = cJSON_CreateObject();
+
+  WpaReply r(reply);
+  WpaReplyField field;
+  while (wanted != 0 && r.next(field))
+  {
+    if (!field.Value)
+      continue;
+    if (fields && !isRequested(fields, field))
+      continue;
+
+    cJSON_AddItemToObject(res, field.Name, cJSON_CreateString(field.Value));
+    if (wanted > 0)
+      wanted--;
+  }
+
+  return res;
+}
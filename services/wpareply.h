@@ -0,0 +1,66 @@
+//
+// Copyright [2018] [Comcast, Corp]
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#ifndef __WPA_REPLY_H__
+#define __WPA_REPLY_H__
+
+#include <string>
+
+#include <stddef.h>
+#include <string.h>
+
+struct cJSON;
+
+// One line of a wpa_supplicant reply. A line without an '=' has a null Value
+struct WpaReplyField
+{
+  char const* Name;
+  size_t      NameLength;
+  char const* Value;
+  size_t      ValueLength;
+
+  template<size_t N>
+  bool is(char const (&name)[N]) const
+    { return NameLength == N - 1 && memcmp(Name, name, N - 1) == 0; }
+
+  // the value as a decimal number, 0 if it isn't one
+  long toLong() const;
+};
+
+// Splits a reply made of name=value lines, like STATUS or BSS, in place.
+// The '=' and newline ending each line are overwritten with NULs, so names
+// and values are C strings pointing into the reply and reading it neither
+// copies nor allocates. The buffer must be NUL terminated at n, as a
+// std::string's is.
+class WpaReply
+{
+public:
+  WpaReply(char* reply, size_t n);
+  explicit WpaReply(std::string& reply);
+
+  // false once every line has been read
+  bool next(WpaReplyField& field);
+
+  // an object with a string member per name=value line. When fields is an
+  // array of names only those lines are added, and the reply is read only
+  // as far as the last of them
+  static cJSON* toJson(std::string& reply, cJSON const* fields = nullptr);
+
+private:
+  char* m_pos;
+  char* m_end;
+};
+
+#endif
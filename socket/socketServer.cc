@@ -0,0 +1,453 @@
+//
+// Copyright [2018] [Comcast, Corp]
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#include "socketServer.h"
+#include "../defs.h"
+#include "../rpclogger.h"
+#include "../util.h"
+#include "../jsonrpc.h"
+#include "../reactor.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <cJSON.h>
+
+namespace
+{
+  char const  kRecordDelimiter      {30};
+  int const   kDefaultMaxClients    {256};
+  int const   kDefaultBacklog       {128};
+  int const   kDefaultMaxRecordSize {64 * 1024};
+  size_t const kReadChunkSize       {4096};
+  size_t const kWriteChunkSize      {16 * 1024};
+
+  // bounds the work done for one connection per pass of the loop so a busy
+  // client can't starve the others. Level triggered epoll brings us back.
+  int const   kMaxReadsPerEvent     {16};
+
+  void setNonBlocking(int fd)
+  {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+      throw_errno(errno, "failed to set socket non-blocking");
+  }
+}
+
+SocketClient::SocketClient(int fd, SocketServer* server, size_t maxRecordSize)
+  : m_fd(fd)
+  , m_server(server)
+  , m_max_record_size(maxRecordSize)
+  , m_outgoing_queue(kRecordDelimiter)
+  , m_flush_pending(false)
+  , m_write_offset(0)
+  , m_epoll_events(0)
+{
+}
+
+SocketClient::~SocketClient()
+{
+  if (m_fd != -1)
+    close(m_fd);
+}
+
+void
+SocketClient::init(DeviceInfoProvider const& UNUSED_PARAM(provider))
+{
+}
+
+void
+SocketClient::enqueueForSend(char const* buff, int n)
+{
+  std::vector<char> record;
+  record.reserve(n + 1);
+  record.insert(record.end(), buff, buff + n);
+  enqueueForSend(std::move(record));
+}
+
+void
+SocketClient::enqueueForSend(std::vector<char>&& record)
+{
+  m_outgoing_queue.put_line(std::move(record));
+
+  // only the first send since the last flush needs to wake the loop
+  if (!m_flush_pending.exchange(true))
+    m_server->scheduleFlush(m_fd);
+}
+
+void
+SocketClient::enqueuePartial(std::vector<char>&& part, bool last)
+{
+  m_outgoing_queue.put_partial(std::move(part), last);
+  if (!m_flush_pending.exchange(true))
+    m_server->scheduleFlush(m_fd);
+}
+
+bool
+SocketClient::waitForSendSpace(size_t limit, std::chrono::milliseconds timeout)
+{
+  return m_outgoing_queue.wait_for_space(limit, timeout);
+}
+
+bool
+SocketClient::onReadable()
+{
+  char buff[kReadChunkSize];
+
+  for (int i = 0; i < kMaxReadsPerEvent; ++i)
+  {
+    ssize_t n = recv(m_fd, buff, sizeof(buff), 0);
+    if (n == 0)
+    {
+      XLOG_INFO("client:%d closed connection", m_fd);
+      return false;
+    }
+
+    if (n < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+        return true;
+
+      XLOG_WARN("error reading from client:%d. %s", m_fd, strerror(errno));
+      return false;
+    }
+
+    char const* p = buff;
+    char const* end = buff + n;
+    while (p < end)
+    {
+      char const* delim = static_cast<char const *>(memchr(p, kRecordDelimiter, end - p));
+      char const* last = delim ? delim : end;
+
+      m_incoming_buff.insert(m_incoming_buff.end(), p, last);
+      if (m_incoming_buff.size() > m_max_record_size)
+      {
+        XLOG_WARN("client:%d sent a record larger than %zu bytes, closing",
+          m_fd, m_max_record_size);
+        return false;
+      }
+
+      if (delim)
+      {
+        m_incoming_buff.push_back('\0');
+        if (!m_data_handler)
+          XLOG_WARN("no data handler registered");
+        else
+          m_data_handler(&m_incoming_buff[0], static_cast<int>(m_incoming_buff.size() - 1));
+        m_incoming_buff.clear();
+        last = delim + 1;
+      }
+
+      p = last;
+    }
+  }
+
+  return true;
+}
+
+bool
+SocketClient::onWritable()
+{
+  // cleared before draining so that anything queued from here on schedules
+  // another flush
+  m_flush_pending = false;
+
+  while (true)
+  {
+    if (m_write_offset == m_write_buff.size())
+    {
+      m_write_buff.resize(kWriteChunkSize);
+      m_write_offset = 0;
+
+      // get_line stops at the end of a record, keep going until the chunk is
+      // full or the queue is empty
+      size_t n = 0;
+      while (n < kWriteChunkSize)
+      {
+        int bytes_read = m_outgoing_queue.get_line(&m_write_buff[n],
+          static_cast<int>(kWriteChunkSize - n));
+        if (bytes_read <= 0)
+          break;
+        n += bytes_read;
+      }
+
+      m_write_buff.resize(n);
+      if (n == 0)
+        return true;
+    }
+
+    ssize_t n = send(m_fd, &m_write_buff[m_write_offset], m_write_buff.size() - m_write_offset,
+      MSG_NOSIGNAL);
+    if (n < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+        return true;
+
+      XLOG_WARN("error writing to client:%d. %s", m_fd, strerror(errno));
+      return false;
+    }
+
+    m_write_offset += n;
+  }
+}
+
+SocketServer::SocketServer()
+  : m_listen_fd(-1)
+  , m_max_clients(kDefaultMaxClients)
+  , m_max_record_size(kDefaultMaxRecordSize)
+{
+}
+
+SocketServer::~SocketServer()
+{
+  for (auto const& itr : m_clients)
+    Reactor::main().removeFd(itr.first);
+  m_clients.clear();
+
+  if (m_listen_fd != -1)
+  {
+    Reactor::main().removeFd(m_listen_fd);
+    close(m_listen_fd);
+  }
+
+  if (!m_unix_path.empty())
+    unlink(m_unix_path.c_str());
+}
+
+void
+SocketServer::init(cJSON const* conf)
+{
+  char const* name = JsonRpc::getString(conf, "name", true);
+  if (strcmp(name, "unix") == 0)
+    initUnixSocket(conf);
+  else
+    initTcpSocket(conf);
+
+  int backlog = JsonRpc::getInt(conf, "backlog", false, kDefaultBacklog);
+  if (listen(m_listen_fd, backlog) < 0)
+    throw_errno(errno, "failed to listen on socket");
+
+  setNonBlocking(m_listen_fd);
+
+  m_max_clients = JsonRpc::getInt(conf, "max-clients", false, kDefaultMaxClients);
+  if (m_max_clients < 1)
+    m_max_clients = 1;
+
+  int maxRecordSize = JsonRpc::getInt(conf, "max-record-size", false, kDefaultMaxRecordSize);
+  if (maxRecordSize < 1)
+  {
+    XLOG_WARN("invalid max-record-size:%d, using %d", maxRecordSize, kDefaultMaxRecordSize);
+    maxRecordSize = kDefaultMaxRecordSize;
+  }
+  m_max_record_size = static_cast<size_t>(maxRecordSize);
+}
+
+void
+SocketServer::initUnixSocket(cJSON const* conf)
+{
+  char const* path = JsonRpc::getString(conf, "path", true);
+
+  sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(addr.sun_path))
+    throw_errno(ENAMETOOLONG, "invalid unix socket path %s", path);
+  strcpy(addr.sun_path, path);
+
+  m_listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (m_listen_fd < 0)
+    throw_errno(errno, "failed to create unix socket");
+
+  // a stale socket file left behind by a previous run would fail the bind
+  unlink(path);
+
+  if (bind(m_listen_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0)
+    throw_errno(errno, "failed to bind unix socket %s", path);
+
+  m_unix_path = path;
+  XLOG_INFO("listening on unix socket:%s", path);
+}
+
+void
+SocketServer::initTcpSocket(cJSON const* conf)
+{
+  char const* address = JsonRpc::getString(conf, "address", false, "127.0.0.1");
+  int port = JsonRpc::getInt(conf, "port", true);
+
+  addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_PASSIVE | AI_NUMERICSERV;
+
+  std::string service = std::to_string(port);
+
+  addrinfo* addrs = nullptr;
+  int ret = getaddrinfo(address, service.c_str(), &hints, &addrs);
+  if (ret != 0)
+    throw_errno(EINVAL, "failed to resolve %s:%d. %s", address, port, gai_strerror(ret));
+
+  m_listen_fd = socket(addrs->ai_family, addrs->ai_socktype | SOCK_CLOEXEC, addrs->ai_protocol);
+  if (m_listen_fd < 0)
+  {
+    int err = errno;
+    freeaddrinfo(addrs);
+    throw_errno(err, "failed to create tcp socket");
+  }
+
+  int reuse = 1;
+  setsockopt(m_listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+  ret = bind(m_listen_fd, addrs->ai_addr, addrs->ai_addrlen);
+  int err = errno;
+  freeaddrinfo(addrs);
+
+  if (ret < 0)
+    throw_errno(err, "failed to bind tcp socket %s:%d", address, port);
+
+  XLOG_INFO("listening on tcp socket:%s:%d", address, port);
+}
+
+void
+SocketServer::run(DeviceInfoProvider const& UNUSED_PARAM(deviceInfoProvider),
+  RpcClientHandler const& onConnect, RpcClientHandler const& onDisconnect)
+{
+  m_on_connect = onConnect;
+  m_on_disconnect = onDisconnect;
+
+  int ret = Reactor::main().addFd(m_listen_fd, EPOLLIN, "socket-listener",
+    [this](uint32_t) { onAcceptReady(); });
+  if (ret)
+    throw_errno(ret, "failed to add listen socket to reactor");
+
+  Reactor::main().run();
+}
+
+void
+SocketServer::onAcceptReady()
+{
+  while (true)
+  {
+    int fd = accept4(m_listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      if (errno != EAGAIN && errno != EWOULDBLOCK)
+        XLOG_WARN("failed to accept socket connection. %s", strerror(errno));
+      return;
+    }
+
+    if (static_cast<int>(m_clients.size()) >= m_max_clients)
+    {
+      XLOG_WARN("rejecting connection, already serving %zu clients", m_clients.size());
+      close(fd);
+      continue;
+    }
+
+    // responses are written whole, there's nothing to gain from Nagle. This
+    // fails harmlessly on unix sockets.
+    int nodelay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+    std::shared_ptr<SocketClient> client(new SocketClient(fd, this, m_max_record_size));
+
+    if (Reactor::main().addFd(fd, EPOLLIN, "socket-client",
+      [this, fd](uint32_t events) { onClientEvent(fd, events); }) != 0)
+      continue;
+    client->setEpollEvents(EPOLLIN);
+
+    m_clients.insert(std::make_pair(fd, client));
+    XLOG_INFO("accepted client:%d, %zu connected", fd, m_clients.size());
+
+    if (m_on_connect)
+      m_on_connect(client);
+  }
+}
+
+void
+SocketServer::scheduleFlush(int fd)
+{
+  // a client may have closed after it queued data, or its fd may have been
+  // reused by a new connection. Either way flushing is harmless.
+  Reactor::main().post([this, fd] { onClientEvent(fd, EPOLLOUT); });
+}
+
+void
+SocketServer::onClientEvent(int fd, uint32_t events)
+{
+  auto itr = m_clients.find(fd);
+  if (itr == m_clients.end())
+    return;
+
+  std::shared_ptr<SocketClient> client = itr->second;
+
+  bool ok = true;
+  if (events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+    ok = client->onReadable();
+  if (ok && (events & EPOLLOUT))
+    ok = client->onWritable();
+
+  if (!ok)
+    closeClient(fd);
+  else
+    updateClientEvents(*client);
+}
+
+void
+SocketServer::updateClientEvents(SocketClient& client)
+{
+  uint32_t wanted = EPOLLIN;
+  if (client.wantsWrite())
+    wanted |= EPOLLOUT;
+
+  if (wanted == client.epollEvents())
+    return;
+
+  if (Reactor::main().modifyFd(client.fd(), wanted) == 0)
+    client.setEpollEvents(wanted);
+}
+
+void
+SocketServer::closeClient(int fd)
+{
+  auto itr = m_clients.find(fd);
+  if (itr == m_clients.end())
+    return;
+
+  std::shared_ptr<SocketClient> client = itr->second;
+  m_clients.erase(itr);
+
+  Reactor::main().removeFd(fd);
+
+  // once the rpc server lets go this is the last reference and the socket is
+  // closed when it goes out of scope
+  if (m_on_disconnect)
+    m_on_disconnect(client);
+
+  XLOG_INFO("closed client:%d, %zu connected", fd, m_clients.size());
+}
@@ -0,0 +1,113 @@
+//
+// Copyright [2018] [Comcast, Corp]
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#ifndef __SOCKET_SERVER_H__
+#define __SOCKET_SERVER_H__
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "../record_queue.h"
+#include "../rpcserver.h"
+
+class SocketServer;
+
+class SocketClient : public RpcConnectedClient
+{
+public:
+  SocketClient(int fd, SocketServer* server, size_t maxRecordSize);
+  virtual ~SocketClient();
+
+  virtual void init(DeviceInfoProvider const& provider) override;
+  virtual void enqueueForSend(char const* buff, int n) override;
+  virtual void enqueueForSend(std::vector<char>&& record) override;
+  virtual bool waitForSendSpace(size_t limit, std::chrono::milliseconds timeout) override;
+  virtual void setDataHandler(RpcDataHandler const& handler) override
+    { m_data_handler = handler; }
+
+  // both return false once the connection should be closed
+  bool onReadable();
+  bool onWritable();
+
+  // true while there are bytes waiting for the socket to become writable
+  bool wantsWrite() const
+    { return m_write_offset < m_write_buff.size(); }
+
+  int fd() const
+    { return m_fd; }
+
+  // events currently registered with the reactor
+  uint32_t epollEvents() const
+    { return m_epoll_events; }
+  void setEpollEvents(uint32_t events)
+    { m_epoll_events = events; }
+
+protected:
+  virtual void enqueuePartial(std::vector<char>&& part, bool last) override;
+
+private:
+  int                 m_fd;
+  SocketServer*       m_server;
+  size_t              m_max_record_size;
+  record_queue        m_outgoing_queue;
+  std::atomic<bool>   m_flush_pending;
+  std::vector<char>   m_incoming_buff;
+  std::vector<char>   m_write_buff;
+  size_t              m_write_offset;
+  uint32_t            m_epoll_events;
+  RpcDataHandler      m_data_handler;
+};
+
+// Serves JSON-RPC over a Unix domain or TCP stream socket. Records are framed
+// with the same ASCII Record Separator used on the BLE Inbox. The listening
+// socket and every connection are sources on the main reactor, which run()
+// drives on the calling thread.
+class SocketServer : public RpcListener
+{
+public:
+  SocketServer();
+  virtual ~SocketServer();
+
+  virtual void init(cJSON const* conf) override;
+  virtual void run(DeviceInfoProvider const& deviceInfoProvider,
+    RpcClientHandler const& onConnect, RpcClientHandler const& onDisconnect) override;
+
+  // called from any thread when a client has queued data to send
+  void scheduleFlush(int fd);
+
+private:
+  void initUnixSocket(cJSON const* conf);
+  void initTcpSocket(cJSON const* conf);
+  void onAcceptReady();
+  void onClientEvent(int fd, uint32_t events);
+  void updateClientEvents(SocketClient& client);
+  void closeClient(int fd);
+
+private:
+  int             m_listen_fd;
+  int             m_max_clients;
+  size_t          m_max_record_size;
+  std::string     m_unix_path;
+  RpcClientHandler                              m_on_connect;
+  RpcClientHandler                              m_on_disconnect;
+  std::map< int, std::shared_ptr<SocketClient> > m_clients;
+};
+
+#endif
@@ -14,6 +14,14 @@
 // limitations under the License.
 //
 #include "util.h"
+#include "rpclogger.h"
+
+#include <sstream>
+#include <stdexcept>
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
 
 std::vector <std::string>
 split(std::string const& str, std::string const& delim)
@@ -44,4 +52,32 @@ std::string runCommand(char const* command)
   fgets(buffer, sizeof(buffer) - 1, fp);
   pclose(fp);
   return std::string(buffer);
-}
\ No newline at end of file
+}
+
+void
+throw_errno(int e, char const* fmt, ...)
+{
+  char buff[256] = {0};
+
+  va_list args;
+  va_start(args, fmt);
+  vsnprintf(buff, sizeof(buff), fmt, args);
+  buff[sizeof(buff) - 1] = '\0';
+  va_end(args);
+
+  char err[256] = {0};
+  char* p = strerror_r(e, err, sizeof(err));
+
+  std::stringstream out;
+  if (strlen(buff) > 0)
+  {
+    out << buff;
+    out << ". ";
+  }
+  if (p && strlen(p) > 0)
+    out << p;
+
+  std::string message(out.str());
+  XLOG_ERROR("exception:%s", message.c_str());
+  throw std::runtime_error(message);
+}
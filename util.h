@@ -29,4 +29,10 @@ std::vector<std::string> split(std::string const& str, std::string const& delim)
  */
 std::string runCommand(char const* cmd);
 
+/**
+ * log and throw std::runtime_error with the message and strerror(err)
+ */
+void throw_errno(int err, char const* fmt, ...)
+  __attribute__ ((format (printf, 2, 3), noreturn));
+
 #endif